@@ -16,16 +16,40 @@
 ******************************************************************************/
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 /* Limits */
 #define ID_SZ   32     /* maximum identifier length */
-#define SRC_SZ  64000  /* up to ~4k lines of C source code */
-#define OUT_SZ  256000 /* up to ~20k lines of assembly output */
+#define SRC_SZ  256000 /* up to ~16k lines of C source code */
+#define OUT_SZ  1000000 /* up to ~80k lines of assembly output */
 #define LOC_SZ  800    /* up to 20 local variables */
-#define GBL_SZ  6400   /* up to 160 global identifiers (f + v) */
+#define GBL_SZ  16000  /* up to 400 global identifiers (f + v) */
 #define ARG_SZ  200    /* up to 5 arguments per function */
+#define CALL_SZ 16     /* up to 15 arguments per call */
 #define CNST_SZ 6400   /* up to 160 defined constants */
-#define LINE_SZ 80     /* assumed line size for assembly */
+#define VS_SZ   64     /* operand stack depth */
+#define INS_SZ  65536  /* up to 32k instructions per function, half spare */
+#define NAME_SZ 131072 /* label and symbol names per function */
+#define BLK_SZ  1024   /* basic blocks per function */
+#define DEF_SZ  240    /* frame slot definitions per function */
+#define DEF_W   8      /* words in a set of definitions */
+#define SLOT_SZ 128    /* frame slots of locals that may share storage */
+#define SLOT_W  1024   /* words in sets of slots, one set per slot */
+#define LVN_SZ  256    /* values numbered in a run of blocks */
+#define RCH_SZ  8192   /* sets of definitions for all blocks */
+#define FN_SZ   512    /* functions in the call graph */
+#define REF_SZ  4096   /* calls in the call graph, one per callee */
+#define CG_SZ   32768  /* call graph names */
+#define INL_SZ  128    /* inline functions */
+#define INL_POOL 16384 /* inline function names and arguments */
+#define INL_INS 24     /* instructions in a function inlined by default */
+#define MEM_UNROLL 64  /* largest constant size copied without rep */
+#define SW_SZ   256    /* case labels of nested switch statements */
+#define ROT_INS 16     /* instructions of a loop test copied to its bottom */
+#define PROF_SZ 131072 /* profile read back, 8 bytes per counter */
+#define STR_SZ  8192   /* distinct string literals */
+#define ALIGN_BIG 64   /* global arrays this large start on a cache line */
 
 /* Supported types */
 #define TYPE_NONE  0
@@ -36,18 +60,166 @@
 #define TYPE_PTR1  64
 #define TYPE_ARR   128
 
+/* Registers */
+#define REG_AX   0
+#define REG_BX   1
+#define REG_CX   2
+#define REG_DX   3
+#define REG_SI   4
+#define REG_DI   5
+#define REG_BP   6
+#define REG_SP   7
+#define REG_R8   8
+#define REG_IP   16  /* not allocatable, for addressing only */
+#define REG_CNT  16
+#define REG_POOL 9   /* registers available for operands */
+#define ARG_REGS 6   /* arguments passed in registers with -abi=sysv */
+
+/* Operand stack entry kinds */
+#define VS_MEM   0  /* spilled to machine stack */
+#define VS_REG   1  /* cached in a register */
+#define VS_CONST 2  /* known at compile time */
+#define VS_FLAGS 3  /* comparison result held in CPU flags */
+
+/* Condition codes, the inverse of a condition differs in lowest bit */
+#define CC_E  0
+#define CC_NE 1
+#define CC_L  2
+#define CC_GE 3
+#define CC_G  4
+#define CC_LE 5
+
+/* Constant folding limits: results must not depend on whether
+ * the compiler itself was built with 32 or 64 bit integers */
+#define FOLD_LIM 1073741824
+#define FOLD_MUL 32768
+
+/* Variable storage classes */
+#define VAR_NONE   0
+#define VAR_FRAME  1  /* locals and arguments, addressed by %rbp */
+#define VAR_GLOBAL 2  /* addressed by %rip */
+#define VAR_INLINE 3  /* arguments of an inlined function, by %rsp */
+
+/* Instruction opcodes, in the order of mnemonics in ins_write */
+#define OP_NOP    0   /* deleted */
+#define OP_MOV    1
+#define OP_MOVZB  2
+#define OP_LEA    3
+#define OP_MOVB   4
+#define OP_ADD    5
+#define OP_SUB    6
+#define OP_AND    7
+#define OP_OR     8
+#define OP_IMUL   9
+#define OP_SHL    10
+#define OP_SHR    11
+#define OP_NOT    12
+#define OP_CMP    13
+#define OP_TEST   14
+#define OP_MUL    15
+#define OP_DIV    16
+#define OP_XOR    17
+#define OP_MOVABS 18
+#define OP_PUSH   19
+#define OP_POP    20
+#define OP_JMP    21  /* condition code set if it leaves the function */
+#define OP_JCC    22
+#define OP_CALL   23
+#define OP_RET    24
+#define OP_SETCC  25  /* setcc and movzbq to the same register */
+#define OP_REP    26  /* rep movsb, or rep stosb if condition code set */
+#define OP_VMOV   27  /* movdqu, or vmovdqu with -mavx2 */
+#define OP_VSPLAT 28  /* register to every element, ins_cc tells size */
+#define OP_JTAB   29  /* jump through the table of entries right before */
+#define OP_LABEL  30
+#define OP_TEXT   31  /* line of text */
+#define OP_STMT   32  /* statement comment, points to source */
+#define OP_ASM    33  /* line of inline assembly, points to source */
+#define OP_CASE   34  /* jump table entry, names the target and the table */
+
+/* Instruction operand kinds */
+#define K_NONE 0
+#define K_REG  1  /* register */
+#define K_IMM  2  /* immediate number */
+#define K_IMMS 3  /* immediate given by name or text */
+#define K_MEM  4  /* [name or offset](register) */
+#define K_IDX  5  /* (register,register,scale) */
+#define K_SYM  6  /* bare name */
+#define K_VEC  7  /* vector register */
+
+/* Dataflow sets: bits used per word, same for 32 and 64 bit int */
+#define SET_BITS 30
+
+/* Flags as a pseudo-register of liveness masks */
+#define LIVE_FLAGS 17
+
+/* Loop invariants are kept in r12 to r15, which operands never use */
+#define LICM_REG 12
+#define LICM_CNT 4
+#define LICM_OCC 64  /* invariant computations replaced in one loop */
+
+/* Loops are vectorized by following values of registers and frame
+ * slots over an iteration, each as c + n1 * x1 + n2 * x2 of values
+ * x1, x2 some of them had when the iteration started */
+#define SV_SLOTS 8   /* frame slots a loop may use */
+#define SV_LOCS  24  /* registers, then frame slots */
+#define SV_A     24  /* operand values */
+#define SV_B     25
+#define SV_ADDR  26  /* address stored to */
+#define SV_VAL   27  /* value stored */
+#define SV_D     28  /* difference compared by the loop test */
+#define SV_CNT   29
+#define SV_AFF   1   /* value kinds other than unknown */
+#define SV_LOADB 2   /* byte loaded from the address given by the terms */
+#define SV_LOADQ 3   /* quadword loaded likewise */
+#define VEC_INS  96  /* room taken for a vector loop */
+
+/* A switch with this many cases or more goes through a jump table,
+ * as long as the table has at most SW_DENSE entries per case */
+#define SW_TABLE 4
+#define SW_DENSE 3
+
+/* Profiles: -fprofile-generate builds programs counting how often
+ * every label is reached, -fprofile-use reads the counts back */
+#define PROF_GEN 1
+#define PROF_USE 2
+#define PROF_BIG 1073741824 /* counts are read up to this */
+#define PROF_HOT 100        /* entries per hottest count to inline */
+
+/* Condition codes of labels tell what the profile says about them */
+#define LBL_COLD 1  /* never reached */
+#define LBL_HOT  2  /* reached */
+
+/* Peephole optimizer rules count */
+#define PEEP_RULES 9
+
 /* Sections */
 #define SECTION_TEXT 0
 #define SECTION_DATA 1
+#define SECTION_RODATA 2
+#define SECTION_BSS 3
 
 /* Procedure declarations */
 int parse_label();
 int parse_statement();
 int parse_loop_for();
 int parse_loop_while();
+int parse_switch();
+int parse_case();
 int parse_conditional();
 int parse_expr(int *type);
 int type_sizeof(int type);
+int gen_cmd_drop();
+int vs_settle();
+int vs_pop();
+int reg_pool(int n);
+int arg_reg(int n);
+int arg_slots(int argc);
+int fold_fits(int v, int lim);
+int ins_of_label(char *name);
+int frame_escapes();
+int cg_add(char *name, char *sta);
+int cg_close();
 
 /* Global variables: Code arrays */
 char source[SRC_SZ];
@@ -63,6 +235,7 @@ char locals[LOC_SZ];     /* function locals list */
 char arguments[ARG_SZ];  /* function arguments list */
 char globals[GBL_SZ]     /* global variable list */;
 char constants[CNST_SZ]; /* constant list */
+char leaves[GBL_SZ];     /* functions with a copy without frame */
 
 /* Global variables: Pointers */
 char *src_p = 0; /* source code read pointer */
@@ -71,12 +244,138 @@ char *out_p = 0; /* assembly output write pointer */
 /* Global variables: Loops work area */
 int lbl_cnt = 0;     /* Label counter. Used for temporary labels */
 char *lbl_sta = 0;   /* Nearest loop start label */
-char *lbl_end = 0;   /* Nearest loop end label */
+char *lbl_end = 0;   /* Nearest loop or switch end label */
+
+/* Global variables: Switch work area
+ * Cases of nested switch statements are kept sorted by value, those of
+ * the innermost one start at sw_base. Cases with literals too long for
+ * a constant come after the others. */
+int sw_val[SW_SZ];    /* case values */
+char *sw_lbl[SW_SZ];  /* case labels */
+char *sw_big[SW_SZ];  /* case literals too long for a value, or 0 */
+int sw_cnt = 0;       /* number of cases */
+int sw_base = 0;      /* first case of the nearest switch */
+char *sw_def = 0;     /* its default label, 0 outside of a switch */
+
+/* Global variables: String literals
+ * Each distinct literal is kept once, pointing to where it first shows
+ * up in the source. Its label is made from its index, see str_label. */
+char *str_src[STR_SZ]; /* literals, each ends with a quote */
+int str_cnt = 0;       /* number of literals */
+
+/* Global variables: Operand stack
+ * Expression operands are tracked at compile time. The topmost of them
+ * are cached in registers, the rest are spilled to machine stack. */
+char vs_kind[VS_SZ];    /* entry kinds */
+char vs_reg[VS_SZ];     /* entry registers */
+int vs_val[VS_SZ];      /* entry values for constants, conditions for flags */
+char reg_busy[REG_CNT]; /* register occupancy */
+int reg_rsv = 0;        /* registers being vacated, not to be allocated */
+int vs_cnt = 0;         /* operand stack depth */
+
+/* Global variables: Instruction buffer
+ * Code of a function is collected as instruction records before it is
+ * optimized and written out. Each record has an opcode, a condition
+ * code and two operands: source (a) and destination (b), each being a
+ * kind, a register, a number and a name. */
+char ins_op[INS_SZ];    /* opcodes */
+char ins_cc[INS_SZ];    /* condition codes */
+char ins_ak[INS_SZ];    /* source kinds */
+char ins_ar[INS_SZ];    /* source registers */
+int ins_an[INS_SZ];     /* source numbers */
+char *ins_as[INS_SZ];   /* source names */
+char ins_bk[INS_SZ];    /* destination kinds */
+char ins_br[INS_SZ];    /* destination registers */
+int ins_bn[INS_SZ];     /* destination numbers */
+char *ins_bs[INS_SZ];   /* destination names */
+int ins_cnt = 0;        /* number of instructions */
+char ins_names[NAME_SZ]; /* name pool */
+char *names_p = 0;      /* name pool write pointer */
+
+/* Global variables: Control-flow graph and dataflow */
+int blk_sta[BLK_SZ];    /* first instruction of a block */
+int blk_end[BLK_SZ];    /* instruction after the last one of a block */
+int blk_next[BLK_SZ];   /* block it falls through to, -1 if none */
+int blk_jump[BLK_SZ];   /* block it jumps to, -1 if none */
+char blk_live[BLK_SZ];  /* block is reachable */
+int blk_sp[BLK_SZ];     /* stack pointer offset at block start */
+int blk_pred[BLK_SZ];   /* only block leading to a block, -1 if none or more */
+char sv_kind[SV_CNT];   /* kinds of values followed over a loop */
+int sv_c[SV_CNT];       /* constant parts */
+int sv_b1[SV_CNT];      /* locations of terms, -1 if none */
+int sv_n1[SV_CNT];      /* factors of terms */
+int sv_b2[SV_CNT];
+int sv_n2[SV_CNT];
+int sv_inc[SV_LOCS];    /* steps of locations over an iteration */
+int sv_off[SV_SLOTS];   /* frame slots behind locations */
+int sv_slots = 0;       /* number of frame slots */
+int blk_cnt = 0;        /* number of blocks */
+int live_in[BLK_SZ];    /* registers live at block start */
+int def_ins[DEF_SZ];    /* store of a definition, -1 for entry value */
+int def_off[DEF_SZ];    /* frame slot of a definition */
+int def_cnt = 0;        /* number of definitions */
+int reach_in[RCH_SZ];   /* definitions reaching block start */
+int reach_out[RCH_SZ];  /* definitions reaching block end */
+int slot_in[RCH_SZ];    /* frame slots of locals live at block start */
+int slot_conf[SLOT_W];  /* slots live at the same time as each one */
+int slot_map[SLOT_SZ];  /* slot each one moves to */
+char lvn_op[LVN_SZ];    /* opcodes computing numbered values */
+char lvn_k[LVN_SZ];     /* their source kinds */
+int lvn_a[LVN_SZ];      /* numbers of destination or base values */
+int lvn_n[LVN_SZ];      /* numbers of source values, or immediates */
+char *lvn_s[LVN_SZ];    /* names of memory operands */
+int lvn_v[LVN_SZ];      /* numbers of the values */
+char lvn_mem[LVN_SZ];   /* 1 for loads of frame slots, 2 of other memory */
+int lvn_reg[REG_CNT];   /* numbers of values registers hold */
+int lvn_cnt = 0;        /* values numbered */
+int lvn_last = 0;       /* last number given out */
+
+/* Global variables: Call graph
+ * Functions are listed with their place in the output, so that those
+ * never called from main can be cut out of it in the end. */
+char *fn_name[FN_SZ];   /* function names */
+char *fn_sta[FN_SZ];   /* function start in the output */
+char *fn_end[FN_SZ];   /* function end in the output */
+char fn_used[FN_SZ];    /* reachable from main */
+int fn_cnt = 0;         /* number of functions */
+int ref_fn[REF_SZ];     /* function making a call */
+char *ref_name[REF_SZ]; /* function being called */
+int ref_cnt = 0;        /* number of calls */
+char cg_names[CG_SZ];   /* name pool */
+char *cg_p = 0;         /* name pool write pointer */
+int cg_full = 0;        /* some limit is exceeded, keep everything */
+
+/* Global variables: Inline functions
+ * A function is inlined by compiling the expression it returns right
+ * at the call site. Its arguments list is kept to resolve names. */
+char *inl_name[INL_SZ]; /* function names */
+char *inl_expr[INL_SZ]; /* returned expressions in the source */
+char *inl_args[INL_SZ]; /* arguments lists */
+int inl_argc[INL_SZ];   /* number of arguments */
+int inl_cnt = 0;        /* number of inline functions */
+char inl_pool[INL_POOL]; /* copies of names and arguments lists */
+char *inl_p = 0;        /* pool write pointer */
+char *inl_vars = 0;     /* arguments of the function being inlined */
+int inl_base = 0;       /* stack entries up to its first argument */
+int inl_order = 0;      /* 0 if its first argument is on top, else the
+                         * number of arguments, the last one on top */
+int inl_used = 0;       /* a call was substituted in the current body */
 
 /* Global variables: Misc */
 int line_number = 0; /* Current source line number */
-char *last_str = 0;  /* Last output string */
+int err_cnt = 0;     /* Errors reported, any of them fails the compile */
 int section = 0;     /* Linkage section */
+int opt_level = 0;   /* Optimization level: -O enables global passes */
+int abi_sysv = 0;    /* Calling convention: 1 passes arguments in registers */
+int alloc_reg = REG_DI; /* Register holding array allocation pointer */
+int vec_avx = 0;      /* Vector width: 1 uses 256-bit AVX2 registers */
+int arg_addr = 0;    /* Address of an argument is taken in the function */
+int prof_mode = 0;   /* Profile: PROF_GEN or PROF_USE, 0 for none */
+int prof_cnt = 0;    /* counters placed so far */
+int prof_max = 0;    /* largest count */
+int prof_fn = 0;     /* entries into the function, -1 if not known */
+int prof_len = 0;    /* bytes of the profile read */
+char prof_buf[PROF_SZ]; /* profile as the program wrote it */
 
 #if 0
 /******************************************************************************
@@ -111,6 +410,40 @@ int puts(char *s) {
 	}
 	putchar (10);
 }
+
+int open(char *name, int flags) {
+	int fd = 0;
+	asm {
+	movq $2, %rax        # syscall = open
+	movq 8(%rbp), %rdi   # file name
+	movq 16(%rbp), %rsi  # flags
+	movq $0, %rdx        # mode
+	syscall
+	movq %rax, -24(%rbp) # fd = %rax
+	}
+	return fd;
+}
+
+int read(int fd, char *buf, int size) {
+	int n = 0;
+	asm {
+	movq $0, %rax        # syscall = read
+	movq 8(%rbp), %rdi   # file
+	movq 16(%rbp), %rsi  # buffer
+	movq 24(%rbp), %rdx  # size
+	syscall
+	movq %rax, -24(%rbp) # n = %rax
+	}
+	return n;
+}
+
+int close(int fd) {
+	asm {
+	movq $3, %rax        # syscall = close
+	movq 8(%rbp), %rdi   # file
+	syscall
+	}
+}
 #endif
 
 /******************************************************************************
@@ -118,21 +451,12 @@ int puts(char *s) {
 ******************************************************************************/
 
 int copy_memory(char *dst, char *src, int size) {
-	while (size) {
-		*dst = *src;
-		dst = dst + 1;
-		src = src + 1;
-		size = size - 1;
-	}
+	__builtin_memcpy (dst, src, size);
 	return 0;
 }
 
 int clear_memory(char *p, int size) {
-	while (size > 0) {
-		*p = (char) 0;
-		p = p + 1;
-		size = size - 1;
-	}
+	__builtin_memset (p, 0, size);
 	return 0;
 }
 
@@ -155,6 +479,41 @@ int new_label(char *dst) {
 	return 1;
 }
 
+/* Makes the label of a string literal from its index */
+int str_label(char *dst, int n) {
+	copy_memory (dst, "_S_", 3);
+	dst = dst + 3;
+	*dst = 'a' + (n % 26);
+	dst = dst + 1;
+	n = n / 26;
+	while (n > 0) {
+		*dst = 'a' + (n % 26);
+		dst = dst + 1;
+		n = n / 26;
+	}
+	*dst = (char) 0;
+	return 1;
+}
+
+/**
+ * Finds the exponent of a power of two
+ *
+ * @param[in] v positive number
+ * @returns k such that v is 2^k, -1 if v is not a power of two
+ */
+int log2_exact(int v) {
+	int p = 1;
+	int k = 0;
+	while (p < v) {
+		p = p + p;
+		k = k + 1;
+	}
+	if (p == v) {
+		return k;
+	}
+	return -1;
+}
+
 int strtonum(char *s) {
 	int n = 0;
 	while (*s) {
@@ -192,14 +551,10 @@ int write_chr(char c) {
 }
 
 int write_str(char *s) {
-	char *last = last_str;
 	while (*s) {
 		write_chr (*s);
-		*last = *s;
-		last = last + 1;
 		s = s + 1;
 	}
-	*last = (char) 0;
 	return 1;
 }
 
@@ -218,6 +573,11 @@ int write_num(int n) {
 		return 1;
 	}
 
+	if (n < 0) {
+		write_chr ('-');
+		n = 0 - n;
+	}
+
 	while (n > 0) {
 		*(buf + i) = '0' + (n % 10);
 		n = n / 10;
@@ -235,6 +595,7 @@ int write_num(int n) {
 }
 
 int write_err(char *s) {
+	err_cnt = err_cnt + 1;
 	write_str ("# [ERROR][L ");
 	write_num (line_number);
 	write_str ("]: ");
@@ -347,6 +708,20 @@ int find_var(char *ptr, char *s, int *t, int *i) {
 	return 0;
 }
 
+/* Counts variables in a varlist */
+int count_vars(char *ptr) {
+	char *fp = ptr;
+	int n = 0;
+	while (*fp) {
+		fp = fp + 1 + type_sizeof (TYPE_INT);
+		while (*fp && (*fp != ' ')) {
+			fp = fp + 1;
+		}
+		n = n + 1;
+	}
+	return n;
+}
+
 /******************************************************************************
 * Character test functions                                                    *
 ******************************************************************************/
@@ -440,9 +815,6 @@ int unread_sym() {
 
 int read_str_const() {
 	while (*src_p && (*src_p != '"')) {
-		write_str (" ");
-		write_num (*src_p);
-		write_str (",");
 		src_p = src_p + 1;
 	}
 	src_p = src_p + 1;
@@ -524,280 +896,6021 @@ int read_number(char *dst) {
 }
 
 /******************************************************************************
-* Code generation functions                                                   *
+* Instruction buffer                                                          *
 ******************************************************************************/
 
-int _gen_cmd_pop_rax() {
-	if (!compare_str (last_str, "  push %rax")) {
-		write_strln ("  pop %rax");
-	} else {
-		out_p = out_p - 12;
-	}
+int ins_reset() {
+	ins_cnt = 0;
+	names_p = ins_names;
 	return 1;
 }
 
-int gen_cmd_swap() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  push %rax");
-	write_strln ("  push %rbx");
+/**
+ * Copies a name into the name pool of the instruction buffer,
+ * so that it outlives the buffer it came from
+ *
+ * @param[in] prefix, name, suffix parts of the name
+ * @returns pointer to the stored name
+ */
+char *ins_name(char *prefix, char *name, char *suffix) {
+	char *s = names_p;
+	if ((names_p - ins_names) > (NAME_SZ - (ID_SZ * 3))) {
+		/* The compile fails, names only have to stay readable */
+		if (!err_cnt) {
+			write_err ("too many names in a function");
+		}
+		return ins_names;
+	}
+	while (*prefix) {
+		*names_p = *prefix;
+		names_p = names_p + 1;
+		prefix = prefix + 1;
+	}
+	while (*name) {
+		*names_p = *name;
+		names_p = names_p + 1;
+		name = name + 1;
+	}
+	while (*suffix) {
+		*names_p = *suffix;
+		names_p = names_p + 1;
+		suffix = suffix + 1;
+	}
+	*names_p = (char) 0;
+	names_p = names_p + 1;
+	return s;
+}
+
+/* Appends an instruction with no operands */
+int ins_new(int op) {
+	if (ins_cnt == (INS_SZ / 2)) {
+		/* The compile fails, parsing stops at the next statement */
+		if (!err_cnt) {
+			write_err ("function is too long");
+		}
+		ins_cnt = ins_cnt - 1;
+	}
+	*((char*) ins_op + ins_cnt) = (char) op;
+	*((char*) ins_cc + ins_cnt) = (char) 0;
+	*((char*) ins_ak + ins_cnt) = (char) K_NONE;
+	*((char*) ins_bk + ins_cnt) = (char) K_NONE;
+	ins_cnt = ins_cnt + 1;
+	return ins_cnt - 1;
+}
+
+/* Sets source operand of the last instruction */
+int ins_src(int k, int r, int n, char *s) {
+	*((char*) ins_ak + ins_cnt - 1) = (char) k;
+	*((char*) ins_ar + ins_cnt - 1) = (char) r;
+	*((int*) ins_an + ins_cnt - 1) = n;
+	*((char**) ins_as + ins_cnt - 1) = s;
 	return 1;
 }
 
-int gen_cmd_pushns(char *value) {
-	write_str ("  movq $");
-	write_str (value);
-	write_strln (", %rax");
-	write_strln ("  push %rax");
+/* Sets destination operand of the last instruction */
+int ins_dst(int k, int r, int n, char *s) {
+	*((char*) ins_bk + ins_cnt - 1) = (char) k;
+	*((char*) ins_br + ins_cnt - 1) = (char) r;
+	*((int*) ins_bn + ins_cnt - 1) = n;
+	*((char**) ins_bs + ins_cnt - 1) = s;
 	return 1;
 }
 
-int gen_cmd_pushni(int value) {
-	write_str ("  movq $");
-	write_num (value);
-	write_strln (", %rax");
-	write_strln ("  push %rax");
+/* Copies instructions to a range apart from where they are */
+int ins_copy(int dst, int src, int n) {
+	int i = sizeof (int);
+	int p = sizeof (char*);
+	__builtin_memcpy ((char*) ins_op + dst, (char*) ins_op + src, n);
+	__builtin_memcpy ((char*) ins_cc + dst, (char*) ins_cc + src, n);
+	__builtin_memcpy ((char*) ins_ak + dst, (char*) ins_ak + src, n);
+	__builtin_memcpy ((char*) ins_ar + dst, (char*) ins_ar + src, n);
+	__builtin_memcpy ((char*) ins_an + (dst * i), (char*) ins_an + (src * i), n * i);
+	__builtin_memcpy ((char*) ins_as + (dst * p), (char*) ins_as + (src * p), n * p);
+	__builtin_memcpy ((char*) ins_bk + dst, (char*) ins_bk + src, n);
+	__builtin_memcpy ((char*) ins_br + dst, (char*) ins_br + src, n);
+	__builtin_memcpy ((char*) ins_bn + (dst * i), (char*) ins_bn + (src * i), n * i);
+	__builtin_memcpy ((char*) ins_bs + (dst * p), (char*) ins_bs + (src * p), n * p);
 	return 1;
 }
 
-int gen_cmd_pushl(char *name) {
-	write_str ("  leaq ");
-	write_str (name);
-	write_strln ("(%rip), %rax");
-	write_strln ("  push %rax");
+int ins_get_op(int i) {
+	return *((char*) ins_op + i);
+}
+
+int ins_set_op(int i, int op) {
+	*((char*) ins_op + i) = (char) op;
 	return 1;
 }
 
-int gen_cmd_pushi(int type) {
-	_gen_cmd_pop_rax ();
-	if (type == TYPE_CHR) {
-		write_strln ("  movzbq (%rax), %rax");
-	} else {
-		write_strln ("  movq (%rax), %rax");
+/* Tests if two operands are the same, second is given by index */
+int ins_same_opd(int k, int r, int n, char *s, int i) {
+	if ((k != *((char*) ins_ak + i))
+			|| (r != *((char*) ins_ar + i))
+			|| (n != *((int*) ins_an + i))) {
+		return 0;
 	}
-	write_strln ("  push %rax");
-	return 1;
+	if ((s == NULL) || (*((char**) ins_as + i) == NULL)) {
+		return (s == *((char**) ins_as + i));
+	}
+	return compare_str (s, *((char**) ins_as + i));
 }
 
-int gen_cmd_popi(int type) {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	if (type == TYPE_CHR) {
-		write_strln ("  mov %al, (%rbx)");
+/******************************************************************************
+* Instruction output                                                          *
+******************************************************************************/
+
+int write_reg(int r) {
+	char *names = "axbxcxdxsidibpsp";
+	write_str ("%r");
+	if (r == REG_IP) {
+		write_str ("ip");
+	} else if (r < REG_R8) {
+		write_chr (*(names + (r * 2)));
+		write_chr (*(names + (r * 2) + 1));
 	} else {
-		write_strln ("  movq %rax, (%rbx)");
+		write_num (r);
 	}
 	return 1;
 }
 
-int gen_cmd_inv() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  notq %rax");
-	write_strln ("  push %rax");
+int write_reg8(int r) {
+	char *names = "abcdsdbs";
+	write_chr ('%');
+	if (r < REG_R8) {
+		write_chr (*(names + r));
+		if (r == REG_SI) {
+			write_chr ('i');
+		} else if (r == REG_DI) {
+			write_chr ('i');
+		} else if (r > REG_DI) {
+			write_chr ('p');
+		}
+		write_chr ('l');
+	} else {
+		write_chr ('r');
+		write_num (r);
+		write_chr ('b');
+	}
 	return 1;
 }
 
-int gen_cmd_add() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  add %rbx, %rax");
-	write_strln ("  push %rax");
+int write_cc(int cc) {
+	char *names = "e nel geg le";
+	write_chr (*(names + (cc * 2)));
+	if (*(names + (cc * 2) + 1) != ' ') {
+		write_chr (*(names + (cc * 2) + 1));
+	}
 	return 1;
 }
 
-int gen_cmd_sub() {
-	write_strln ("  pop %rbx");
-	write_strln ("  pop %rax");
-	write_strln ("  sub %rbx, %rax");
-	write_strln ("  push %rax");
-	return 1;
+int cc_not(int cc) {
+	if (cc % 2) {
+		return cc - 1;
+	}
+	return cc + 1;
 }
 
-int gen_cmd_call(char *name) {
-	/* Save old base to stack, set a new base */
-	write_strln ("  push %rbp");
-	write_strln ("  movq %rsp, %rbp");
-	write_str ("  call ");
-	write_strln (name);
-	/* Restore old base from stack */
-	write_strln ("  pop %rbp");
-	return 1;
+/* Condition that holds with operands swapped */
+int cc_swap(int cc) {
+	if (cc < CC_L) {
+		return cc;
+	}
+	if (cc < CC_G) {
+		return cc + 2;
+	}
+	return cc - 2;
 }
 
-int gen_cmd_pushsf() {
-	write_strln ("  push %rbp");
+/* Writes a vector register, 256-bit wide with -mavx2 */
+int write_vec(int r) {
+	if (vec_avx) {
+		write_str ("%ymm");
+	} else {
+		write_str ("%xmm");
+	}
+	write_num (r);
 	return 1;
 }
 
-int gen_cmd_jump(char *name) {
-	write_str ("  jmp ");
-	write_strln (name);
+/* Writes an operand, registers are 8 bit wide if byte is set */
+int write_opd(int k, int r, int n, char *s, int byte) {
+	if (k == K_REG) {
+		if (byte) {
+			write_reg8 (r);
+		} else {
+			write_reg (r);
+		}
+	} else if (k == K_IMM) {
+		write_chr ('$');
+		write_num (n);
+	} else if (k == K_IMMS) {
+		write_chr ('$');
+		write_str (s);
+	} else if (k == K_SYM) {
+		write_str (s);
+	} else if (k == K_IDX) {
+		write_chr ('(');
+		write_reg (r);
+		write_chr (',');
+		write_reg (r);
+		write_chr (',');
+		write_num (n);
+		write_chr (')');
+	} else if (k == K_MEM) {
+		if (s) {
+			write_str (s);
+			if (n) {
+				write_chr ('+');
+				write_num (n);
+			}
+		} else if (n) {
+			write_num (n);
+		}
+		write_chr ('(');
+		write_reg (r);
+		write_chr (')');
+	} else if (k == K_VEC) {
+		write_vec (r);
+	}
 	return 1;
 }
 
-int gen_cmd_jump_x(char *prefix, char *name, char *suffix) {
-	write_str ("  jmp ");
-	write_str (prefix);
-	write_str (name);
-	write_strln (suffix);
+/* Writes a vector instruction taking a register twice, as SSE2 does,
+ * or the 128-bit half of it first, as AVX2 broadcasts do */
+int write_vec_op(char *mn, int r) {
+	write_str (mn);
+	write_str (" %xmm");
+	write_num (r);
+	write_str (", ");
+	write_vec (r);
+	write_chr (10);
 	return 1;
 }
 
-int gen_cmd_nzjump(char *name) {
-	_gen_cmd_pop_rax ();
-	write_strln ("  cmpq $0, %rax");
-	write_str ("  jne ");
-	write_strln (name);
-	return 1;
+/* Writes a broadcast of a register to a vector register */
+int write_splat(int size, int a, int r) {
+	if (vec_avx) {
+		write_str ("  vmovq ");
+	} else {
+		write_str ("  movq ");
+	}
+	write_reg (a);
+	write_str (", %xmm");
+	write_num (r);
+	write_chr (10);
+	if (vec_avx && (size == 1)) {
+		return write_vec_op ("  vpbroadcastb", r);
+	} else if (vec_avx) {
+		return write_vec_op ("  vpbroadcastq", r);
+	}
+	if (size == 1) {
+		write_vec_op ("  punpcklbw", r);
+		write_vec_op ("  pshuflw $0,", r);
+	}
+	return write_vec_op ("  punpcklqdq", r);
 }
 
-int gen_cmd_push_static(char *name, int type) {
-	if (type == TYPE_CHR) {
+/* Writes text of an instruction */
+int ins_write(int i) {
+	char *names = "        movq    movzbq  leaq    movb    add     sub     and     or      imulq   shl     shr     notq    cmp     test    mulq    divq    xor     movabsq push    pop     jmp     j       call    ret     ";
+	char *mn = NULL;
+	int op = ins_get_op (i);
+	int ak = *((char*) ins_ak + i);
+	int bk = *((char*) ins_bk + i);
+	int br = *((char*) ins_br + i);
+	char *as = *((char**) ins_as + i);
+	char *p = as;
+
+	if (op == OP_NOP) {
+		return 1;
+	} else if (op == OP_LABEL) {
+		write_str (as);
+		write_strln (":");
+		return 1;
+	} else if (op == OP_TEXT) {
+		write_strln (as);
+		return 1;
+	} else if (op == OP_STMT) {
+		/* Show line of statement as comment */
+		write_str ("# St.: ");
+		while ((*p != ';') && (*p != 10) && (*p != '{')) {
+			write_chr (*p);
+			p = p + 1;
+		}
+		write_chr (10);
+		return 1;
+	} else if (op == OP_ASM) {
+		write_str ("  ");
+		while ((*p != 10) && (*p != '}')) {
+			write_chr (*p);
+			p = p + 1;
+		}
+		write_chr (10);
+		return 1;
+	} else if (op == OP_SETCC) {
+		write_str ("  set");
+		write_cc (*((char*) ins_cc + i));
+		write_chr (' ');
+		write_reg8 (br);
+		write_chr (10);
 		write_str ("  movzbq ");
-	} else if (type & TYPE_ARR) {
+		write_reg8 (br);
+		write_str (", ");
+		write_reg (br);
+		write_chr (10);
+		return 1;
+	} else if (op == OP_VSPLAT) {
+		return write_splat (*((char*) ins_cc + i), *((char*) ins_ar + i), br);
+	} else if (op == OP_REP) {
+		if (*((char*) ins_cc + i)) {
+			write_strln ("  rep stosb");
+		} else {
+			write_strln ("  rep movsb");
+		}
+		return 1;
+	} else if (op == OP_CASE) {
+		/* Entries go to read-only data, named after the fallback label */
+		if (ins_get_op (i - 1) != OP_CASE) {
+			write_strln (" .pushsection .rodata");
+			write_strln (" .p2align 2");
+			write_str (*((char**) ins_bs + i));
+			write_strln ("_tab:");
+		}
+		write_str (" .long ");
+		write_str (as);
+		write_str (" - ");
+		write_str (*((char**) ins_bs + i));
+		write_strln ("_tab");
+		return 1;
+	} else if (op == OP_JTAB) {
+		/* Entries are offsets from the table, so it needs no relocations */
+		write_strln (" .popsection");
 		write_str ("  leaq ");
+		write_str (as);
+		write_str ("_tab(%rip), ");
+		write_reg (br);
+		write_chr (10);
+		write_str ("  movslq (");
+		write_reg (br);
+		write_chr (',');
+		write_reg (*((char*) ins_ar + i));
+		write_str (",4), ");
+		write_reg (*((char*) ins_ar + i));
+		write_chr (10);
+		write_str ("  add ");
+		write_reg (br);
+		write_str (", ");
+		write_reg (*((char*) ins_ar + i));
+		write_chr (10);
+		write_str ("  jmp *");
+		write_reg (*((char*) ins_ar + i));
+		write_chr (10);
+		return 1;
+	}
+
+	write_str ("  ");
+	if (op == OP_VMOV) {
+		if (vec_avx) {
+			write_chr ('v');
+		}
+		mn = "movdqu ";
 	} else {
-		write_str ("  movq ");
+		mn = names + (op * 8);
 	}
-	write_str (name);
-	write_strln ("(%rip), %rax");
-	write_strln ("  push %rax");
+	while (*mn != ' ') {
+		write_chr (*mn);
+		mn = mn + 1;
+	}
+	if (op == OP_JCC) {
+		write_cc (*((char*) ins_cc + i));
+	}
+	if ((ak == K_IMM) && (bk == K_MEM) && (*(mn - 1) != 'q')
+			&& (op != OP_MOVB)) {
+		/* Nothing else tells the operand size */
+		write_chr ('q');
+	}
+	if (ak) {
+		write_chr (' ');
+		write_opd (ak, *((char*) ins_ar + i), *((int*) ins_an + i), as,
+				(op == OP_MOVB) || (op == OP_MOVZB));
+	}
+	if (bk) {
+		if (ak) {
+			write_chr (',');
+		}
+		write_chr (' ');
+		write_opd (bk, br, *((int*) ins_bn + i), *((char**) ins_bs + i), 0);
+	}
+	write_chr (10);
 	return 1;
 }
 
-int gen_cmd_pop_static(char *name, int type) {
-	_gen_cmd_pop_rax ();
-	write_str ("  movq %rax, ");
-	write_str (name);
-	write_strln ("(%rip)");
-	return 1;
-}
+/******************************************************************************
+* Peephole optimizer                                                          *
+******************************************************************************/
 
-int gen_cmd_label_x(char *prefix, char *name, char *suffix) {
-	write_str (prefix);
-	write_str (name);
-	write_str (suffix);
-	write_strln (":");
-	return 1;
+/* Tests if an instruction has no effect on program state */
+int ins_is_void(int i) {
+	return (ins_get_op (i) == OP_NOP) || (ins_get_op (i) == OP_STMT);
 }
 
-int gen_cmd_label(char *name) {
-	return gen_cmd_label_x("", name, "");
+/* Tests if an instruction was generated from an expression,
+ * unlike labels, data and inline assembly */
+int ins_is_code(int i) {
+	return (ins_get_op (i) > OP_NOP) && (ins_get_op (i) < OP_LABEL);
 }
 
-int gen_cmd_not() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  test %rax, %rax");
-	write_strln ("  sete %al");
-	write_strln ("  andq $0xff, %rax");
-	write_strln ("  push %rax");
-	return 1;
+/* Finds next instruction that does something */
+int ins_next(int i) {
+	i = i + 1;
+	while ((i < ins_cnt) && ins_is_void (i)) {
+		i = i + 1;
+	}
+	return i;
 }
 
-int gen_cmd_and() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  and %rbx, %rax");
-	write_strln ("  push %rax");
-	return 1;
+/* Finds out if a jump target is placed before the next instruction */
+int ins_label_follows(int i, char *name) {
+	i = i + 1;
+	while (i < ins_cnt) {
+		if (ins_get_op (i) == OP_LABEL) {
+			if (compare_str (name, *((char**) ins_as + i))) {
+				return 1;
+			}
+		} else if (!ins_is_void (i)) {
+			return 0;
+		}
+		i = i + 1;
+	}
+	return 0;
 }
 
-int gen_cmd_or() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  or %rbx, %rax");
-	write_strln ("  push %rax");
+/* push X; pop Y => movq X, Y */
+int peep_push_pop(int i, int j) {
+	if ((ins_get_op (i) != OP_PUSH) || (ins_get_op (j) != OP_POP)) {
+		return 0;
+	}
+	ins_set_op (i, OP_MOV);
+	*((char*) ins_bk + i) = (char) K_REG;
+	*((char*) ins_br + i) = *((char*) ins_ar + j);
+	ins_set_op (j, OP_NOP);
 	return 1;
 }
 
-int gen_cmd_dup() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  push %rax");
-	write_strln ("  push %rax");
-	return 1;
+/* movq %a, %a => nothing */
+int peep_self_mov(int i) {
+	if ((ins_get_op (i) != OP_MOV)
+			|| (*((char*) ins_ak + i) != K_REG)
+			|| (*((char*) ins_bk + i) != K_REG)
+			|| (*((char*) ins_ar + i) != *((char*) ins_br + i))) {
+		return 0;
+	}
+	return ins_set_op (i, OP_NOP);
 }
 
-int gen_cmd_drop() {
-	/* drop into RDX because RAX contains return value */
-	write_strln ("  pop %rdx");
-	return 1;
+/* jmp L; L: => L: */
+int peep_jump_next(int i) {
+	if ((ins_get_op (i) != OP_JMP) && (ins_get_op (i) != OP_JCC)) {
+		return 0;
+	}
+	if (!ins_label_follows (i, *((char**) ins_as + i))) {
+		return 0;
+	}
+	return ins_set_op (i, OP_NOP);
 }
 
-int _gen_cmd_cmp(char *cond) {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  xor %rdx, %rdx");
-	write_strln ("  cmp %rax, %rbx");
-	write_str ("  set");
-	write_str (cond);
-	write_strln (" %dl");
-	write_strln ("  push %rdx");
-	return 1;
+/* jmp L; <code> M: => jmp L; M: */
+int peep_dead_code(int i, int j) {
+	if ((ins_get_op (i) != OP_JMP) && (ins_get_op (i) != OP_RET)) {
+		return 0;
+	}
+	if ((j >= ins_cnt) || !ins_is_code (j)) {
+		return 0;
+	}
+	return ins_set_op (j, OP_NOP);
 }
 
-int gen_cmd_cmpeq() {
-	return _gen_cmd_cmp ("e");
+/* notq %a; notq %a => nothing */
+int peep_not_not(int i, int j) {
+	if ((ins_get_op (i) != OP_NOT) || (ins_get_op (j) != OP_NOT)
+			|| (*((char*) ins_ak + i) != *((char*) ins_ak + j))
+			|| (*((char*) ins_ar + i) != *((char*) ins_ar + j))) {
+		return 0;
+	}
+	ins_set_op (i, OP_NOP);
+	return ins_set_op (j, OP_NOP);
 }
 
-int gen_cmd_cmpne() {
-	return _gen_cmd_cmp ("ne");
+/* movq %a, M; movq M, %b => movq %a, M; movq %a, %b */
+int peep_store_load(int i, int j) {
+	int op = ins_get_op (i);
+	if (!(((op == OP_MOV) && (ins_get_op (j) == OP_MOV))
+			|| ((op == OP_MOVB) && (ins_get_op (j) == OP_MOVZB)))) {
+		return 0;
+	}
+	if ((*((char*) ins_bk + i) != K_MEM)
+			|| (*((char*) ins_bk + j) != K_REG)) {
+		return 0;
+	}
+	if (!ins_same_opd (K_MEM, *((char*) ins_br + i),
+				*((int*) ins_bn + i), *((char**) ins_bs + i), j)) {
+		return 0;
+	}
+	if ((*((char*) ins_ak + i) != K_REG)
+			&& (*((char*) ins_ak + i) != K_IMM)) {
+		return 0;
+	}
+	*((char*) ins_ak + j) = *((char*) ins_ak + i);
+	*((char*) ins_ar + j) = *((char*) ins_ar + i);
+	*((int*) ins_an + j) = *((int*) ins_an + i);
+	*((char**) ins_as + j) = *((char**) ins_as + i);
+	if (*((char*) ins_ak + i) == K_IMM) {
+		/* Immediate byte is read back zero-extended */
+		ins_set_op (j, OP_MOV);
+		if (op == OP_MOVB) {
+			*((int*) ins_an + j) = *((int*) ins_an + j) & 255;
+		}
+	}
+	return 1;
 }
 
-int gen_cmd_cmplt() {
-	return _gen_cmd_cmp ("l");
+/* jcc L; jmp M; L: => jncc M; L: */
+int peep_jcc_jmp(int i, int j) {
+	if ((ins_get_op (i) != OP_JCC) || (ins_get_op (j) != OP_JMP)) {
+		return 0;
+	}
+	if (!ins_label_follows (j, *((char**) ins_as + i))) {
+		return 0;
+	}
+	*((char*) ins_cc + i) = (char) cc_not (*((char*) ins_cc + i));
+	*((char**) ins_as + i) = *((char**) ins_as + j);
+	return ins_set_op (j, OP_NOP);
 }
 
-int gen_cmd_cmple() {
-	return _gen_cmd_cmp ("le");
+/* movq %a, %b; movq %b, %a => movq %a, %b */
+int peep_mov_back(int i, int j) {
+	if ((ins_get_op (i) != OP_MOV) || (ins_get_op (j) != OP_MOV)
+			|| (*((char*) ins_ak + i) != K_REG)
+			|| (*((char*) ins_bk + i) != K_REG)
+			|| (*((char*) ins_ak + j) != K_REG)
+			|| (*((char*) ins_bk + j) != K_REG)
+			|| (*((char*) ins_ar + i) != *((char*) ins_br + j))
+			|| (*((char*) ins_br + i) != *((char*) ins_ar + j))) {
+		return 0;
+	}
+	return ins_set_op (j, OP_NOP);
 }
 
-int gen_cmd_cmpgt() {
-	return _gen_cmd_cmp ("g");
+/* jmp L; ... L: jmp M => jmp M */
+int peep_jump_jump(int i) {
+	char *name = *((char**) ins_as + i);
+	int l = 0;
+	int n = 0;
+	if ((ins_get_op (i) != OP_JMP) && (ins_get_op (i) != OP_JCC)) {
+		return 0;
+	}
+	/* Follow the chain, jumps going round in a circle are left be */
+	l = ins_of_label (name);
+	while ((l >= 0) && (n < 8)) {
+		while ((l < ins_cnt)
+				&& (ins_is_void (l) || (ins_get_op (l) == OP_LABEL))) {
+			l = l + 1;
+		}
+		if ((l == ins_cnt) || (ins_get_op (l) != OP_JMP)) {
+			break;
+		}
+		name = *((char**) ins_as + l);
+		l = ins_of_label (name);
+		n = n + 1;
+	}
+	if ((n == 0) || (n == 8)) {
+		return 0;
+	}
+	*((char**) ins_as + i) = name;
+	return 1;
 }
 
-int gen_cmd_cmpge() {
-	return _gen_cmd_cmp ("ge");
+/**
+ * Applies a rule of the peephole optimizer
+ *
+ * @param[in] rule rule number, 0 to PEEP_RULES-1
+ * @param[in] i instruction index
+ * @param[in] j index of the next instruction that does something
+ * @returns 1 if code was changed
+ */
+int peep_rule(int rule, int i, int j) {
+	if (rule == 0) return peep_push_pop (i, j);
+	if (rule == 1) return peep_self_mov (i);
+	if (rule == 2) return peep_jump_next (i);
+	if (rule == 3) return peep_dead_code (i, j);
+	if (rule == 4) return peep_not_not (i, j);
+	if (rule == 5) return peep_store_load (i, j);
+	if (rule == 6) return peep_jcc_jmp (i, j);
+	if (rule == 7) return peep_mov_back (i, j);
+	return peep_jump_jump (i);
 }
 
-int gen_cmd_mul() {
-	_gen_cmd_pop_rax ();
-	write_strln ("  pop %rbx");
-	write_strln ("  mulq %rbx");
-	write_strln ("  push %rax");
+/* Runs all peephole rules until code stops changing */
+int peephole() {
+	int changed = 1;
+	int i = 0;
+	int j = 0;
+	int rule = 0;
+	while (changed) {
+		changed = 0;
+		i = 0;
+		while (i < ins_cnt) {
+			if (!ins_is_void (i)) {
+				j = ins_next (i);
+				rule = 0;
+				while (rule < PEEP_RULES) {
+					if (ins_is_void (i)) {
+						break;
+					}
+					if (peep_rule (rule, i, j)) {
+						changed = 1;
+					}
+					rule = rule + 1;
+				}
+			}
+			i = i + 1;
+		}
+	}
 	return 1;
 }
 
-int gen_cmd_div() {
-	write_strln ("  pop %rbx");
-	write_strln ("  pop %rax");
-	write_strln ("  xor %rdx,%rdx");
-	write_strln ("  divq %rbx");
-	write_strln ("  push %rax");
-	return 1;
-}
+/******************************************************************************
+* Control-flow graph                                                          *
+******************************************************************************/
 
-int gen_cmd_mod() {
-	write_strln ("  pop %rbx");
-	write_strln ("  pop %rax");
-	write_strln ("  xor %rdx,%rdx");
-	write_strln ("  divq %rbx");
-	write_strln ("  push %rdx");
-	return 1;
+/* Tests if an instruction ends a basic block */
+int ins_is_branch(int i) {
+	int op = ins_get_op (i);
+	return (op == OP_JMP) || (op == OP_JCC) || (op == OP_RET)
+		|| (op == OP_JTAB);
 }
 
-int gen_global(char *name) {
-	write_str (" .global ");
-	write_strln (name);
-	return 1;
+/* Finds the block that starts with a label, -1 if there is none */
+int blk_of_label(char *name) {
+	int b = 0;
+	while (b < blk_cnt) {
+		if ((ins_get_op (*((int*) blk_sta + b)) == OP_LABEL)
+				&& compare_str (name,
+					*((char**) ins_as + *((int*) blk_sta + b)))) {
+			return b;
+		}
+		b = b + 1;
+	}
+	return 0 - 1;
 }
 
-int gen_section(int sect) {
-	if (sect != section) {
-		section = sect;
+/**
+ * Finds where a block jumps through an entry of its jump table
+ *
+ * @param[in] b block ending with a table jump
+ * @param[in] k entry number
+ * @returns block of the k-th entry, -1 past the last or with no table
+ */
+int blk_case(int b, int k) {
+	int i = *((int*) blk_sta + b);
+	while (i < *((int*) blk_end + b)) {
+		if (ins_get_op (i) == OP_CASE) {
+			if (k == 0) {
+				return blk_of_label (*((char**) ins_as + i));
+			}
+			k = k - 1;
+		}
+		i = i + 1;
+	}
+	return 0 - 1;
+}
+
+/**
+ * Splits buffered instructions into basic blocks and links them
+ * A block starts at a label or after a branch. Every block gets up to
+ * two successors: the one it falls through to and the one it jumps to.
+ * A block ending with a table jump has its entries as successors
+ * instead, see blk_case.
+ *
+ * @returns 0 if the graph cannot be built: the function has inline
+ * assembly, jumps outside of itself or is too large
+ */
+int cfg_build() {
+	int i = 0;
+	int b = 0;
+	int op = 0;
+	blk_cnt = 0;
+	while (i < ins_cnt) {
+		op = ins_get_op (i);
+		if (op == OP_ASM) {
+			return 0;
+		}
+		if ((i == 0) || (op == OP_LABEL) || ins_is_branch (i - 1)) {
+			if (blk_cnt == BLK_SZ) {
+				return 0;
+			}
+			*((int*) blk_sta + blk_cnt) = i;
+			blk_cnt = blk_cnt + 1;
+		}
+		*((int*) blk_end + blk_cnt - 1) = i + 1;
+		i = i + 1;
+	}
+	while (b < blk_cnt) {
+		i = *((int*) blk_end + b) - 1;
+		op = ins_get_op (i);
+		*((int*) blk_next + b) = b + 1;
+		*((int*) blk_jump + b) = 0 - 1;
+		if (((b + 1) == blk_cnt) || (op == OP_JMP) || (op == OP_RET)
+				|| (op == OP_JTAB)) {
+			*((int*) blk_next + b) = 0 - 1;
+		}
+		i = *((int*) blk_sta + b);
+		while (i < *((int*) blk_end + b)) {
+			if ((ins_get_op (i) == OP_CASE)
+					&& (blk_of_label (*((char**) ins_as + i)) < 0)) {
+				return 0;
+			}
+			i = i + 1;
+		}
+		i = *((int*) blk_end + b) - 1;
+		if ((op == OP_JMP) || (op == OP_JCC)) {
+			*((int*) blk_jump + b) = blk_of_label (*((char**) ins_as + i));
+			if (*((int*) blk_jump + b) < 0) {
+				return 0;
+			}
+		}
+		b = b + 1;
+	}
+	return 1;
+}
+
+/******************************************************************************
+* Dataflow analyses                                                           *
+******************************************************************************/
+
+/* 2 to the power of n, for building bit masks */
+int bitmask(int n) {
+	int m = 1;
+	while (n > 0) {
+		m = m * 2;
+		n = n - 1;
+	}
+	return m;
+}
+
+/* Registers an operand reads, memory operands read their base */
+int opd_uses(int k, int r) {
+	if ((k == K_REG) || (k == K_IDX) || ((k == K_MEM) && (r != REG_IP))) {
+		return bitmask (r);
+	}
+	return 0;
+}
+
+/* Tests if an instruction writes its destination without reading it */
+int ins_is_load(int i) {
+	int op = ins_get_op (i);
+	return (op == OP_MOV) || (op == OP_MOVZB) || (op == OP_LEA)
+		|| (op == OP_MOVB) || (op == OP_MOVABS) || (op == OP_SETCC);
+}
+
+/* Tests if an instruction changes flags */
+int ins_sets_flags(int i) {
+	int op = ins_get_op (i);
+	return ((op >= OP_ADD) && (op <= OP_XOR) && (op != OP_MOVB)
+			&& (op != OP_NOT)) || (op == OP_CALL) || (op == OP_JTAB);
+}
+
+/* Registers that hold frame and allocation pointers stay live */
+int live_fixed() {
+	return bitmask (REG_SP) | bitmask (REG_BP) | bitmask (alloc_reg);
+}
+
+/* Registers and flags an instruction reads */
+int ins_uses(int i) {
+	int op = ins_get_op (i);
+	int m = 0;
+	int n = 0;
+	if ((op == OP_POP) || !ins_is_code (i)) {
+		return 0;
+	}
+	m = opd_uses (*((char*) ins_ak + i), *((char*) ins_ar + i));
+	if (op == OP_JTAB) {
+		/* Destination is scratch */
+		return m;
+	}
+	if ((*((char*) ins_bk + i) == K_MEM) || !ins_is_load (i)) {
+		m = m | opd_uses (*((char*) ins_bk + i), *((char*) ins_br + i));
+	}
+	if ((op == OP_SETCC) || (op == OP_JCC)) {
+		m = m | bitmask (LIVE_FLAGS);
+	} else if ((op == OP_MUL) || (op == OP_RET)) {
+		m = m | bitmask (REG_AX);
+	} else if (op == OP_DIV) {
+		m = m | bitmask (REG_AX) | bitmask (REG_DX);
+	} else if (op == OP_REP) {
+		/* Byte to fill with, or where to copy from */
+		m = m | bitmask (REG_DI) | bitmask (REG_CX);
+		if (*((char*) ins_cc + i)) {
+			m = m | bitmask (REG_AX);
+		} else {
+			m = m | bitmask (REG_SI);
+		}
+	} else if (op == OP_CALL) {
+		/* Callee finds its arguments through the base pointer,
+		 * or in registers with al telling how many vector ones */
+		m = m | live_fixed ();
+		if (abi_sysv) {
+			m = m | bitmask (REG_AX);
+			while (n < ARG_REGS) {
+				m = m | bitmask (arg_reg (n));
+				n = n + 1;
+			}
+		}
+	}
+	return m;
+}
+
+/* Registers and flags an instruction writes */
+int ins_defs(int i) {
+	int op = ins_get_op (i);
+	int m = 0;
+	int n = 0;
+	if (!ins_is_code (i)) {
+		return 0;
+	}
+	if ((op == OP_POP) || (op == OP_NOT)) {
+		m = bitmask (*((char*) ins_ar + i));
+	} else if ((*((char*) ins_bk + i) == K_REG)
+			&& (op != OP_CMP) && (op != OP_TEST)) {
+		m = bitmask (*((char*) ins_br + i));
+	}
+	if (ins_sets_flags (i)) {
+		m = m | bitmask (LIVE_FLAGS);
+	}
+	if ((op == OP_MUL) || (op == OP_DIV)) {
+		m = m | bitmask (REG_AX) | bitmask (REG_DX);
+	} else if (op == OP_JTAB) {
+		m = m | bitmask (*((char*) ins_ar + i));
+	} else if (op == OP_REP) {
+		m = bitmask (REG_DI) | bitmask (REG_CX);
+		if (!*((char*) ins_cc + i)) {
+			m = m | bitmask (REG_SI);
+		}
+	} else if (op == OP_CALL) {
+		while (n < REG_POOL) {
+			m = m | bitmask (reg_pool (n));
+			n = n + 1;
+		}
+	}
+	return m;
+}
+
+/* Live registers before an instruction given those after it */
+int live_step(int i, int live) {
+	return (live & ~ins_defs (i)) | ins_uses (i);
+}
+
+/* Live registers at the end of a block */
+int live_at_end(int b) {
+	int m = live_fixed ();
+	int k = 0;
+	if (*((int*) blk_next + b) >= 0) {
+		m = m | *((int*) live_in + *((int*) blk_next + b));
+	}
+	if (*((int*) blk_jump + b) >= 0) {
+		m = m | *((int*) live_in + *((int*) blk_jump + b));
+	}
+	while (blk_case (b, k) >= 0) {
+		m = m | *((int*) live_in + blk_case (b, k));
+		k = k + 1;
+	}
+	return m;
+}
+
+/* Finds registers and flags live at the start of every block */
+int live_solve() {
+	int b = 0;
+	int i = 0;
+	int m = 0;
+	int changed = 1;
+	while (b < blk_cnt) {
+		*((int*) live_in + b) = 0;
+		b = b + 1;
+	}
+	while (changed) {
+		changed = 0;
+		b = blk_cnt - 1;
+		while (b >= 0) {
+			m = live_at_end (b);
+			i = *((int*) blk_end + b) - 1;
+			while (i >= *((int*) blk_sta + b)) {
+				m = live_step (i, m);
+				i = i - 1;
+			}
+			if (m != *((int*) live_in + b)) {
+				*((int*) live_in + b) = m;
+				changed = 1;
+			}
+			b = b - 1;
+		}
+	}
+	return 1;
+}
+
+/* Tests if an instruction writes a frame slot */
+int ins_is_def(int i) {
+	return ins_is_code (i)
+		&& (*((char*) ins_bk + i) == K_MEM)
+		&& (*((char*) ins_br + i) == REG_BP)
+		&& (*((char**) ins_bs + i) == NULL);
+}
+
+/* Tests if an instruction reads a frame slot into a register */
+int ins_is_use(int i) {
+	int op = ins_get_op (i);
+	return ((op == OP_MOV) || (op == OP_MOVZB))
+		&& (*((char*) ins_ak + i) == K_MEM)
+		&& (*((char*) ins_ar + i) == REG_BP)
+		&& (*((char**) ins_as + i) == NULL)
+		&& (*((char*) ins_bk + i) == K_REG);
+}
+
+/* Tests if address of a frame slot is taken anywhere in the function */
+int slot_escapes(int off) {
+	int i = 0;
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_LEA)
+				&& (*((char*) ins_ak + i) == K_MEM)
+				&& (*((char*) ins_ar + i) == REG_BP)
+				&& (*((int*) ins_an + i) == off)) {
+			return 1;
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+
+int set_test(int *set, int n) {
+	return (*(set + (n / SET_BITS)) & bitmask (n % SET_BITS)) != 0;
+}
+
+int set_add(int *set, int n) {
+	*(set + (n / SET_BITS)) = *(set + (n / SET_BITS)) | bitmask (n % SET_BITS);
+	return 1;
+}
+
+int set_copy(int *dst, int *src) {
+	int w = 0;
+	while (w < DEF_W) {
+		*(dst + w) = *(src + w);
+		w = w + 1;
+	}
+	return 1;
+}
+
+int set_clear(int *set) {
+	int w = 0;
+	while (w < DEF_W) {
+		*(set + w) = 0;
+		w = w + 1;
+	}
+	return 1;
+}
+
+/* Finds the definition number of a store, -1 if it is not a store */
+int def_of(int i) {
+	int d = 0;
+	while (d < def_cnt) {
+		if (*((int*) def_ins + d) == i) {
+			return d;
+		}
+		d = d + 1;
+	}
+	return 0 - 1;
+}
+
+/* Applies a definition to a set of reaching ones: it replaces the
+ * definitions of the same slot */
+int set_define(int *set, int d) {
+	int k = 0;
+	while (k < def_cnt) {
+		if (*((int*) def_off + k) == *((int*) def_off + d)) {
+			*(set + (k / SET_BITS)) =
+				*(set + (k / SET_BITS)) & ~bitmask (k % SET_BITS);
+		}
+		k = k + 1;
+	}
+	return set_add (set, d);
+}
+
+/* Reaching definitions after an instruction given those before it */
+int reach_step(int *set, int i) {
+	int d = 0;
+	if (ins_is_def (i)) {
+		d = def_of (i);
+		set_define (set, d);
+	}
+	return 1;
+}
+
+/**
+ * Numbers stores to frame slots as definitions
+ * Each slot also gets a definition standing for its value on entry.
+ *
+ * @returns 0 if there are too many of them
+ */
+int reach_defs() {
+	int i = 0;
+	int d = 0;
+	def_cnt = 0;
+	while (i < ins_cnt) {
+		if (ins_is_def (i)) {
+			d = 0;
+			while ((d < def_cnt) && (*((int*) def_off + d)
+						!= *((int*) ins_bn + i))) {
+				d = d + 1;
+			}
+			if ((def_cnt + 2) > DEF_SZ) {
+				return 0;
+			}
+			if (d == def_cnt) {
+				/* First store to the slot adds the entry value */
+				*((int*) def_ins + def_cnt) = 0 - 1;
+				*((int*) def_off + def_cnt) = *((int*) ins_bn + i);
+				def_cnt = def_cnt + 1;
+			}
+			*((int*) def_ins + def_cnt) = i;
+			*((int*) def_off + def_cnt) = *((int*) ins_bn + i);
+			def_cnt = def_cnt + 1;
+		}
+		i = i + 1;
+	}
+	return 1;
+}
+
+/* Merges reaching definitions into the start of a block */
+int reach_merge(int b, int *set) {
+	int w = 0;
+	while (w < DEF_W) {
+		*((int*) reach_in + (b * DEF_W) + w) =
+			*((int*) reach_in + (b * DEF_W) + w) | *(set + w);
+		w = w + 1;
+	}
+	return 1;
+}
+
+/* Finds definitions reaching the start of every block */
+int reach_solve() {
+	int set[DEF_W];
+	int b = 0;
+	int d = 0;
+	int k = 0;
+	int i = 0;
+	int w = 0;
+	int changed = 1;
+	while (b < blk_cnt) {
+		set_clear ((int*) reach_in + (b * DEF_W));
+		set_clear ((int*) reach_out + (b * DEF_W));
+		b = b + 1;
+	}
+	while (changed) {
+		changed = 0;
+		/* Entry values reach the first block */
+		set_clear ((int*) reach_in);
+		while (d < def_cnt) {
+			if (*((int*) def_ins + d) < 0) {
+				set_add ((int*) reach_in, d);
+			}
+			d = d + 1;
+		}
+		b = 0;
+		while (b < blk_cnt) {
+			set_copy (set, (int*) reach_in + (b * DEF_W));
+			i = *((int*) blk_sta + b);
+			while (i < *((int*) blk_end + b)) {
+				reach_step (set, i);
+				i = i + 1;
+			}
+			w = 0;
+			while (w < DEF_W) {
+				if (*(set + w) != *((int*) reach_out + (b * DEF_W) + w)) {
+					changed = 1;
+				}
+				w = w + 1;
+			}
+			set_copy ((int*) reach_out + (b * DEF_W), set);
+			if (*((int*) blk_next + b) >= 0) {
+				reach_merge (*((int*) blk_next + b), set);
+			}
+			if (*((int*) blk_jump + b) >= 0) {
+				reach_merge (*((int*) blk_jump + b), set);
+			}
+			k = 0;
+			while (blk_case (b, k) >= 0) {
+				reach_merge (blk_case (b, k), set);
+				k = k + 1;
+			}
+			b = b + 1;
+		}
+		d = 0;
+	}
+	return 1;
+}
+
+/******************************************************************************
+* Global optimizer                                                            *
+******************************************************************************/
+
+/* Tests if an instruction has no effect besides its register results */
+int ins_is_pure(int i) {
+	int op = ins_get_op (i);
+	if (*((char*) ins_bk + i) == K_MEM) {
+		return 0;
+	}
+	return ((op >= OP_MOV) && (op <= OP_TEST) && (op != OP_MOVB))
+		|| (op == OP_XOR) || (op == OP_MOVABS) || (op == OP_SETCC);
+}
+
+/* Drops instructions whose results are never read */
+int opt_dead_regs() {
+	int b = 0;
+	int i = 0;
+	int m = 0;
+	int changed = 0;
+	while (b < blk_cnt) {
+		m = live_at_end (b);
+		i = *((int*) blk_end + b) - 1;
+		while (i >= *((int*) blk_sta + b)) {
+			if (ins_is_pure (i) && ins_defs (i)
+					&& !(ins_defs (i) & (m | live_fixed ()))) {
+				ins_set_op (i, OP_NOP);
+				changed = 1;
+			} else {
+				m = live_step (i, m);
+			}
+			i = i - 1;
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/**
+ * Finds the constant a frame slot holds on every path to a load
+ *
+ * @param[in] set definitions reaching the load
+ * @param[in] i index of the load instruction
+ * @param[out] val the constant
+ * @returns 1 if all definitions store the same constant
+ */
+int slot_const(int *set, int i, int *val) {
+	int d = 0;
+	int j = 0;
+	int n = 0;
+	int found = 0;
+	while (d < def_cnt) {
+		if ((*((int*) def_off + d) == *((int*) ins_an + i))
+				&& set_test (set, d)) {
+			j = *((int*) def_ins + d);
+			if ((j < 0) || (*((char*) ins_ak + j) != K_IMM)) {
+				return 0;
+			}
+			n = *((int*) ins_an + j);
+			if (ins_get_op (i) == OP_MOVZB) {
+				n = n & 255;
+			} else if (ins_get_op (j) != OP_MOV) {
+				return 0;
+			}
+			if (found && (n != *val)) {
+				return 0;
+			}
+			*val = n;
+			found = 1;
+		}
+		d = d + 1;
+	}
+	return found;
+}
+
+/* Replaces loads of frame slots known to hold a constant */
+int opt_const_slots() {
+	int set[DEF_W];
+	int b = 0;
+	int i = 0;
+	int n = 0;
+	int changed = 0;
+	while (b < blk_cnt) {
+		set_copy (set, (int*) reach_in + (b * DEF_W));
+		i = *((int*) blk_sta + b);
+		while (i < *((int*) blk_end + b)) {
+			if (ins_is_use (i) && !slot_escapes (*((int*) ins_an + i))
+					&& slot_const (set, i, &n)) {
+				ins_set_op (i, OP_MOV);
+				*((char*) ins_ak + i) = (char) K_IMM;
+				*((char*) ins_ar + i) = (char) 0;
+				*((int*) ins_an + i) = n;
+				changed = 1;
+			}
+			reach_step (set, i);
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/* Registers live after an instruction of a block */
+int live_after(int b, int i) {
+	int m = live_at_end (b);
+	int j = *((int*) blk_end + b) - 1;
+	while (j > i) {
+		m = live_step (j, m);
+		j = j - 1;
+	}
+	return m;
+}
+
+/**
+ * Tests if a register copied by the previous instruction can be
+ * replaced with the original in an operand of this one
+ *
+ * @param[in] b block of the instruction
+ * @param[in] j index of the instruction
+ * @param[in] d register holding the copy
+ * @returns 1 to replace in the source operand, 2 in the destination
+ * operand of a comparison, 0 if the copy is needed
+ */
+int copy_foldable(int b, int j, int d) {
+	int op = ins_get_op (j);
+	int src = opd_uses (*((char*) ins_ak + j), *((char*) ins_ar + j))
+		& bitmask (d);
+	if ((op < OP_MOV) || (op > OP_XOR) || (op == OP_NOT)
+			|| (op == OP_MUL) || (op == OP_DIV)) {
+		return 0;
+	}
+	if (((op == OP_CMP) || (op == OP_TEST)) && !src
+			&& (*((char*) ins_bk + j) == K_REG)
+			&& (*((char*) ins_br + j) == d)) {
+		return 2 * !(live_after (b, j) & bitmask (d));
+	}
+	if (!src || (*((char*) ins_ar + j) != d)) {
+		return 0;
+	}
+	if ((*((char*) ins_bk + j) == K_REG) && (*((char*) ins_br + j) == d)
+			&& ins_is_load (j)) {
+		return 1;
+	}
+	if (opd_uses (*((char*) ins_bk + j), *((char*) ins_br + j))
+			& bitmask (d)) {
+		return 0;
+	}
+	return !(live_after (b, j) & bitmask (d));
+}
+
+/* movq %a, %b; op %b, X => op %a, X when %b is not read later */
+int opt_copies() {
+	int b = 0;
+	int i = 0;
+	int j = 0;
+	int k = 0;
+	int changed = 0;
+	while (b < blk_cnt) {
+		i = *((int*) blk_sta + b);
+		while (i < *((int*) blk_end + b)) {
+			j = ins_next (i);
+			k = 0;
+			if ((ins_get_op (i) == OP_MOV)
+					&& (*((char*) ins_ak + i) == K_REG)
+					&& (*((char*) ins_bk + i) == K_REG)
+					&& (j < *((int*) blk_end + b))) {
+				k = copy_foldable (b, j, *((char*) ins_br + i));
+			}
+			if (k == 1) {
+				*((char*) ins_ar + j) = *((char*) ins_ar + i);
+			} else if (k == 2) {
+				*((char*) ins_br + j) = *((char*) ins_ar + i);
+			}
+			if (k) {
+				ins_set_op (i, OP_NOP);
+				changed = 1;
+			}
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/* Tests if an operand is a memory location addressed by a register */
+int opd_is_based(int k, int r, char *s, int base) {
+	return (k == K_MEM) && (r == base) && (s == NULL);
+}
+
+/**
+ * Tests if an immediate added to a register by the previous instruction
+ * can go to the displacement of a memory operand of this one instead
+ *
+ * @param[in] b block of the instruction
+ * @param[in] j index of the instruction
+ * @param[in] r register the immediate was added to
+ * @param[in] n the immediate
+ * @returns 1 if the addition is not needed
+ */
+int disp_foldable(int b, int j, int r, int n) {
+	int op = ins_get_op (j);
+	int src = opd_is_based (*((char*) ins_ak + j), *((char*) ins_ar + j),
+			*((char**) ins_as + j), r);
+	int dst = opd_is_based (*((char*) ins_bk + j), *((char*) ins_br + j),
+			*((char**) ins_bs + j), r);
+	if ((op < OP_MOV) || (op > OP_XOR) || (op == OP_NOT)
+			|| (op == OP_MUL) || (op == OP_DIV) || (src == dst)) {
+		return 0;
+	}
+	if (src && !fold_fits (*((int*) ins_an + j) + n, FOLD_LIM)) {
+		return 0;
+	}
+	if (dst && ((opd_uses (*((char*) ins_ak + j), *((char*) ins_ar + j))
+				& bitmask (r))
+			|| !fold_fits (*((int*) ins_bn + j) + n, FOLD_LIM))) {
+		return 0;
+	}
+	if (!ins_sets_flags (j)
+			&& (live_after (b, j) & bitmask (LIVE_FLAGS))) {
+		return 0;
+	}
+	if (src && (*((char*) ins_bk + j) == K_REG)
+			&& (*((char*) ins_br + j) == r)) {
+		return ins_is_load (j);
+	}
+	return !(live_after (b, j) & bitmask (r));
+}
+
+/* add $n, %r; op (%r), X => op n(%r), X when %r is not read later */
+int opt_disp() {
+	int b = 0;
+	int i = 0;
+	int j = 0;
+	int n = 0;
+	int changed = 0;
+	while (b < blk_cnt) {
+		i = *((int*) blk_sta + b);
+		while (i < *((int*) blk_end + b)) {
+			j = ins_next (i);
+			n = *((int*) ins_an + i);
+			if (ins_get_op (i) == OP_SUB) {
+				n = 0 - n;
+			}
+			if (((ins_get_op (i) == OP_ADD) || (ins_get_op (i) == OP_SUB))
+					&& (*((char*) ins_ak + i) == K_IMM)
+					&& (*((char*) ins_bk + i) == K_REG)
+					&& (j < *((int*) blk_end + b))
+					&& disp_foldable (b, j, *((char*) ins_br + i), n)) {
+				if (opd_is_based (*((char*) ins_ak + j), *((char*) ins_ar + j),
+							*((char**) ins_as + j), *((char*) ins_br + i))) {
+					*((int*) ins_an + j) = *((int*) ins_an + j) + n;
+				} else {
+					*((int*) ins_bn + j) = *((int*) ins_bn + j) + n;
+				}
+				ins_set_op (i, OP_NOP);
+				changed = 1;
+			}
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/* Notes the block an edge leads from, unless another leads there */
+int blk_pred_add(int b, int p) {
+	if (b < 0) {
+		return 1;
+	}
+	if (*((int*) blk_pred + b) == (0 - 2)) {
+		*((int*) blk_pred + b) = p;
+	} else if (*((int*) blk_pred + b) != p) {
+		*((int*) blk_pred + b) = 0 - 1;
+	}
+	return 1;
+}
+
+/* Finds the only block leading to every block */
+int blk_preds() {
+	int b = 0;
+	int k = 0;
+	while (b < blk_cnt) {
+		*((int*) blk_pred + b) = 0 - 2;
+		b = b + 1;
+	}
+	b = 0;
+	while (b < blk_cnt) {
+		blk_pred_add (*((int*) blk_next + b), b);
+		blk_pred_add (*((int*) blk_jump + b), b);
+		k = 0;
+		while (blk_case (b, k) >= 0) {
+			blk_pred_add (blk_case (b, k), b);
+			k = k + 1;
+		}
+		b = b + 1;
+	}
+	/* The function is entered at the first one */
+	*((int*) blk_pred) = 0 - 1;
+	return 1;
+}
+
+/* Gives every register a value of its own, forgets other values */
+int lvn_reset() {
+	int r = 0;
+	lvn_cnt = 0;
+	while (r < REG_CNT) {
+		lvn_last = lvn_last + 1;
+		*((int*) lvn_reg + r) = lvn_last;
+		r = r + 1;
+	}
+	return 1;
+}
+
+/* Number of the value a memory operand is addressed by */
+int lvn_base(int r) {
+	if (r == REG_IP) {
+		return 0;
+	}
+	return *((int*) lvn_reg + r);
+}
+
+/**
+ * Finds the number of a value, numbering it if it is new
+ *
+ * @param[in] op opcode computing the value
+ * @param[in] k source operand kind
+ * @param[in] a number of the destination value, or of the base
+ * @param[in] n number of the source value, immediate or offset
+ * @param[in] s name of the operand, NULL if none
+ * @param[in] mem 1 if loaded from a frame slot, 2 from other memory
+ * @returns the number
+ */
+int lvn_find(int op, int k, int a, int n, char *s, int mem) {
+	int e = 0;
+	char *t = NULL;
+	while (e < lvn_cnt) {
+		t = *((char**) lvn_s + e);
+		if ((*((char*) lvn_op + e) == op) && (*((char*) lvn_k + e) == k)
+				&& (*((int*) lvn_a + e) == a) && (*((int*) lvn_n + e) == n)
+				&& ((s == t) || (s && t && compare_str (s, t)))) {
+			return *((int*) lvn_v + e);
+		}
+		e = e + 1;
+	}
+	lvn_last = lvn_last + 1;
+	if (lvn_cnt < LVN_SZ) {
+		*((char*) lvn_op + e) = (char) op;
+		*((char*) lvn_k + e) = (char) k;
+		*((int*) lvn_a + e) = a;
+		*((int*) lvn_n + e) = n;
+		*((char**) lvn_s + e) = s;
+		*((int*) lvn_v + e) = lvn_last;
+		*((char*) lvn_mem + e) = (char) mem;
+		lvn_cnt = lvn_cnt + 1;
+	}
+	return lvn_last;
+}
+
+/* Memory a load or a store reaches: 1 for a frame slot no pointer
+ * may reach, 2 for any other memory */
+int lvn_mem_of(int k, int r, char *s, int esc) {
+	if (opd_is_based (k, r, s, REG_BP) && !esc) {
+		return 1;
+	}
+	return 2;
+}
+
+/**
+ * Numbers the value an instruction leaves in its destination register
+ *
+ * @param[in] i instruction index
+ * @param[in] esc address of some frame slot is taken
+ * @returns the number, 0 if the value is not numbered
+ */
+int lvn_value(int i, int esc) {
+	int op = ins_get_op (i);
+	int k = *((char*) ins_ak + i);
+	int r = *((char*) ins_ar + i);
+	int n = *((int*) ins_an + i);
+	char *s = *((char**) ins_as + i);
+	int d = *((char*) ins_br + i);
+	if ((*((char*) ins_bk + i) != K_REG) || (d == REG_SP) || (d == REG_BP)) {
+		return 0;
+	}
+	if ((op == OP_MOV) && (k == K_REG)) {
+		return *((int*) lvn_reg + r);
+	} else if (((op == OP_MOV) || (op == OP_MOVABS)) && (k == K_IMM)) {
+		return lvn_find (OP_MOV, K_IMM, 0, n, NULL, 0);
+	} else if ((op == OP_XOR) && (k == K_REG) && (r == d)) {
+		return lvn_find (OP_MOV, K_IMM, 0, 0, NULL, 0);
+	} else if ((op == OP_MOV) && (k == K_IMMS)) {
+		return lvn_find (OP_MOV, K_IMMS, 0, 0, s, 0);
+	} else if (((op == OP_MOV) || (op == OP_MOVZB)) && (k == K_MEM)) {
+		return lvn_find (op, k, lvn_base (r), n, s, lvn_mem_of (k, r, s, esc));
+	} else if ((op == OP_LEA) && ((k == K_MEM) || (k == K_IDX))) {
+		return lvn_find (op, k, lvn_base (r), n, s, 0);
+	} else if ((op < OP_ADD) || (op > OP_XOR) || (op == OP_NOT)
+			|| (op == OP_CMP) || (op == OP_TEST)
+			|| (op == OP_MUL) || (op == OP_DIV)) {
+		return 0;
+	} else if (k == K_IMM) {
+		return lvn_find (op, k, *((int*) lvn_reg + d), n, NULL, 0);
+	} else if (k == K_REG) {
+		return lvn_find (op, k, *((int*) lvn_reg + d), *((int*) lvn_reg + r),
+				NULL, 0);
+	}
+	return 0;
+}
+
+/* Forgets values loaded from memory an instruction may write */
+int lvn_store(int i, int esc) {
+	int op = ins_get_op (i);
+	int mem = 0;
+	int n = *((int*) ins_bn + i);
+	int e = 0;
+	if ((op == OP_PUSH) || (op == OP_CALL) || (op == OP_REP)) {
+		mem = 2;
+	} else if ((*((char*) ins_bk + i) == K_MEM)
+			&& (op != OP_CMP) && (op != OP_TEST)) {
+		mem = lvn_mem_of (K_MEM, *((char*) ins_br + i),
+				*((char**) ins_bs + i), esc);
+	}
+	while (mem && (e < lvn_cnt)) {
+		if ((*((char*) lvn_mem + e) == mem) && ((mem == 2)
+					|| (((*((int*) lvn_n + e) - n) < 8)
+						&& ((n - *((int*) lvn_n + e)) < 8)))) {
+			*((char*) lvn_op + e) = (char) OP_NOP;
+		}
+		e = e + 1;
+	}
+	return 1;
+}
+
+/**
+ * Follows values over an instruction. One that computes a value some
+ * register holds already becomes a copy of that register.
+ *
+ * @param[in] b block of the instruction
+ * @param[in] i instruction index
+ * @param[in] esc address of some frame slot is taken
+ * @returns 1 if the instruction was changed
+ */
+int lvn_step(int b, int i, int esc) {
+	int op = ins_get_op (i);
+	int k = *((char*) ins_ak + i);
+	int d = *((char*) ins_br + i);
+	int v = 0;
+	int r = 0;
+	int m = 0;
+	int changed = 0;
+	char *none = NULL;
+	if (!ins_is_code (i)) {
+		return 0;
+	}
+	v = lvn_value (i, esc);
+	if (v && ((k == K_MEM) || (k == K_IDX) || ((op >= OP_ADD)
+					&& !((op == OP_XOR) && (k == K_REG)
+						&& (*((char*) ins_ar + i) == d))))) {
+		while ((r < REG_CNT) && ((r == d) || (*((int*) lvn_reg + r) != v))) {
+			r = r + 1;
+		}
+		if ((r < REG_CNT) && (!ins_sets_flags (i)
+					|| !(live_after (b, i) & bitmask (LIVE_FLAGS)))) {
+			ins_set_op (i, OP_MOV);
+			*((char*) ins_ak + i) = (char) K_REG;
+			*((char*) ins_ar + i) = (char) r;
+			*((int*) ins_an + i) = 0;
+			*((char**) ins_as + i) = none;
+			changed = 1;
+		}
+	}
+	lvn_store (i, esc);
+	m = ins_defs (i);
+	if ((op == OP_PUSH) || (op == OP_POP) || (op == OP_CALL)
+			|| (op == OP_RET)) {
+		m = m | bitmask (REG_SP);
+	}
+	if (op == OP_CALL) {
+		/* The callee may leave anything but the frame */
+		m = m | (bitmask (REG_CNT) - 1 - bitmask (REG_BP));
+	}
+	r = 0;
+	while (r < REG_CNT) {
+		if (m & bitmask (r)) {
+			lvn_last = lvn_last + 1;
+			*((int*) lvn_reg + r) = lvn_last;
+		}
+		r = r + 1;
+	}
+	if (v) {
+		*((int*) lvn_reg + d) = v;
+	}
+	return changed;
+}
+
+/**
+ * Numbers values within runs of blocks each entered only from the one
+ * before it. Addresses, loads and arithmetic computing a value some
+ * register still holds become copies of it, later passes drop what
+ * only fed the repeated computation.
+ *
+ * @returns 1 if code was changed
+ */
+int opt_values() {
+	int esc = frame_escapes ();
+	int b = 0;
+	int i = 0;
+	int changed = 0;
+	blk_preds ();
+	while (b < blk_cnt) {
+		if ((b == 0) || (*((int*) blk_pred + b) != (b - 1))) {
+			lvn_reset ();
+		}
+		i = *((int*) blk_sta + b);
+		while (i < *((int*) blk_end + b)) {
+			changed = lvn_step (b, i, esc) || changed;
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/* Marks a block as reachable, returns 1 if it was not marked before */
+int blk_mark(int b) {
+	if ((b < 0) || *((char*) blk_live + b)) {
+		return 0;
+	}
+	*((char*) blk_live + b) = (char) 1;
+	return 1;
+}
+
+/**
+ * Marks blocks reachable from the function entry
+ * Blocks holding data, like string literals, are reachable through
+ * instructions that take their address.
+ *
+ * @returns 1
+ */
+int cfg_reach() {
+	int b = 0;
+	int i = 0;
+	int changed = 1;
+	clear_memory (blk_live, blk_cnt);
+	blk_mark (0);
+	while (changed) {
+		changed = 0;
+		b = 0;
+		while (b < blk_cnt) {
+			if (*((char*) blk_live + b)) {
+				changed = blk_mark (*((int*) blk_next + b)) || changed;
+				changed = blk_mark (*((int*) blk_jump + b)) || changed;
+				i = *((int*) blk_sta + b);
+				while (i < *((int*) blk_end + b)) {
+					if (ins_get_op (i) == OP_CASE) {
+						changed = blk_mark (blk_of_label (
+									*((char**) ins_as + i))) || changed;
+					}
+					if (ins_is_code (i) && (*((char*) ins_ak + i) == K_MEM)
+							&& *((char**) ins_as + i)) {
+						changed = blk_mark (blk_of_label (
+									*((char**) ins_as + i))) || changed;
+					}
+					i = i + 1;
+				}
+			}
+			b = b + 1;
+		}
+	}
+	return 1;
+}
+
+/* Drops blocks that can never be executed */
+int opt_unreachable() {
+	int b = 0;
+	int i = 0;
+	int changed = 0;
+	cfg_reach ();
+	while (b < blk_cnt) {
+		if (!*((char*) blk_live + b)) {
+			i = *((int*) blk_sta + b);
+			while (i < *((int*) blk_end + b)) {
+				if (!ins_is_void (i)) {
+					ins_set_op (i, OP_NOP);
+					changed = 1;
+				}
+				i = i + 1;
+			}
+		}
+		b = b + 1;
+	}
+	return changed;
+}
+
+/******************************************************************************
+* Loop optimizer                                                              *
+******************************************************************************/
+
+/**
+ * Finds the last block of a loop starting at a block
+ * A loop spans blocks from its header to the last one jumping back
+ * into it, like the body of a for loop jumping to its step.
+ *
+ * @param[in] h header block
+ * @returns last block of the loop, -1 if h is not a loop header
+ */
+int loop_end(int h) {
+	int b = h;
+	int t = 0 - 1;
+	int j = 0;
+	while (b < blk_cnt) {
+		if (*((int*) blk_jump + b) == h) {
+			t = b;
+		}
+		b = b + 1;
+	}
+	b = t + 1;
+	while ((t >= 0) && (b < blk_cnt)) {
+		j = *((int*) blk_jump + b);
+		if ((j >= h) && (j <= t)) {
+			t = b;
+		}
+		b = b + 1;
+	}
+	return t;
+}
+
+/* Tests if a loop is only entered by falling into its header */
+int loop_entry_ok(int h, int t) {
+	int b = 0;
+	int j = 0;
+	if ((h == 0) || (*((int*) blk_next + h - 1) != h)
+			|| (*((int*) blk_jump + h - 1) == h)) {
+		return 0;
+	}
+	while (b < blk_cnt) {
+		j = *((int*) blk_jump + b);
+		if (((b < h) || (b > t)) && (j >= h) && (j <= t)) {
+			return 0;
+		}
+		b = b + 1;
+	}
+	return 1;
+}
+
+/**
+ * Collects registers a loop touches
+ *
+ * @param[in] h, t first and last block of the loop
+ * @param[out] wild set if the loop writes memory outside of the frame
+ * @returns registers used or changed, -1 if the loop makes calls
+ */
+int loop_regs(int h, int t, int *wild) {
+	int i = *((int*) blk_sta + h);
+	int m = 0;
+	*wild = 0;
+	while (i < *((int*) blk_end + t)) {
+		if (ins_get_op (i) == OP_CALL) {
+			return 0 - 1;
+		}
+		if (ins_is_code (i) && ((*((char*) ins_bk + i) == K_IDX)
+					|| (ins_get_op (i) == OP_REP)
+					|| ((*((char*) ins_bk + i) == K_MEM)
+						&& (*((char*) ins_br + i) != REG_BP)))) {
+			*wild = 1;
+		}
+		m = m | ins_uses (i) | ins_defs (i);
+		i = i + 1;
+	}
+	return m;
+}
+
+/* Tests if a frame slot is written inside a loop */
+int loop_stores(int h, int t, int off) {
+	int i = *((int*) blk_sta + h);
+	while (i < *((int*) blk_end + t)) {
+		if (ins_is_def (i) && (*((int*) ins_bn + i) == off)) {
+			return 1;
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+
+/* Tests if address of any frame slot is taken in the function,
+ * other than to restore the stack pointer */
+int frame_escapes() {
+	int i = 0;
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_LEA)
+				&& (*((char*) ins_ak + i) == K_MEM)
+				&& (*((char*) ins_ar + i) == REG_BP)
+				&& (*((char*) ins_br + i) != REG_SP)) {
+			return 1;
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * Tests if an instruction loads a register with the same value
+ * on every iteration of a loop
+ *
+ * @param[in] i instruction index
+ * @param[in] h, t first and last block of the loop
+ * @param[in] wild loop writes memory outside of the frame
+ * @param[in] esc address of some frame slot is taken
+ * @returns 1 if the load can be done before the loop
+ */
+int ins_invariant(int i, int h, int t, int wild, int esc) {
+	int op = ins_get_op (i);
+	int k = *((char*) ins_ak + i);
+	int r = *((char*) ins_ar + i);
+	if ((*((char*) ins_bk + i) != K_REG)
+			|| (*((char*) ins_br + i) == REG_SP)) {
+		return 0;
+	}
+	if (op == OP_MOVABS) {
+		return 1;
+	}
+	if ((k != K_MEM) || ((r != REG_BP) && (r != REG_IP))) {
+		return 0;
+	}
+	if (op == OP_LEA) {
+		return 1;
+	}
+	if ((op != OP_MOV) && (op != OP_MOVZB)) {
+		return 0;
+	}
+	if (r == REG_IP) {
+		return !wild;
+	}
+	return !(esc && wild) && (*((char**) ins_as + i) == NULL)
+		&& !loop_stores (h, t, *((int*) ins_an + i));
+}
+
+/* Tests if an instruction continues an invariant computation in %r */
+int chain_link(int i, int r) {
+	int op = ins_get_op (i);
+	if (op == OP_NOT) {
+		return (*((char*) ins_ar + i) == r);
+	}
+	return (((op >= OP_ADD) && (op <= OP_SHR)) || (op == OP_XOR))
+		&& (*((char*) ins_ak + i) == K_IMM)
+		&& (*((char*) ins_bk + i) == K_REG)
+		&& (*((char*) ins_br + i) == r);
+}
+
+/* Finds the last instruction of an invariant computation */
+int chain_end(int i) {
+	int r = *((char*) ins_br + i);
+	int j = ins_next (i);
+	while ((j < ins_cnt) && chain_link (j, r)) {
+		i = j;
+		j = ins_next (j);
+	}
+	return i;
+}
+
+/* Tests if two invariant computations give the same value */
+int chain_same(int i, int j) {
+	int ei = chain_end (i);
+	int ej = chain_end (j);
+	while (1) {
+		if ((ins_get_op (i) != ins_get_op (j))
+				|| ((ins_get_op (i) != OP_NOT)
+					&& !ins_same_opd (*((char*) ins_ak + i),
+						*((char*) ins_ar + i), *((int*) ins_an + i),
+						*((char**) ins_as + i), j))) {
+			return 0;
+		}
+		if ((i == ei) || (j == ej)) {
+			return (i == ei) && (j == ej);
+		}
+		i = ins_next (i);
+		j = ins_next (j);
+	}
+	return 0;
+}
+
+/* Counts instructions of an invariant computation */
+int chain_len(int i) {
+	int e = chain_end (i);
+	int n = 1;
+	while (i != e) {
+		i = ins_next (i);
+		n = n + 1;
+	}
+	return n;
+}
+
+/* Moves instructions from an index on up to make room for n more */
+int ins_open(int at, int n) {
+	int len = ins_cnt - at;
+	int i = ins_cnt;
+	int k = 0;
+	if ((ins_cnt + n + len) <= INS_SZ) {
+		/* Past the new end and back, each copy going to a range apart */
+		ins_copy (ins_cnt + n, at, len);
+		ins_copy (at + n, ins_cnt + n, len);
+	} else {
+		/* Chunks of n from the end do not reach what they copy */
+		while (i > at) {
+			k = n;
+			if ((i - at) < k) {
+				k = i - at;
+			}
+			i = i - k;
+			ins_copy (i + n, i, k);
+		}
+	}
+	ins_cnt = ins_cnt + n;
+	return 1;
+}
+
+/**
+ * Hoists computations that do not change inside a loop into a
+ * preheader placed before its header label. Each distinct value gets
+ * a register of its own, and the loop copies it from there.
+ *
+ * @param[in] h, t first and last block of the loop
+ * @returns 1 if code was changed
+ */
+int loop_hoist(int h, int t) {
+	int sta[LICM_CNT];
+	int reg[LICM_CNT];
+	int occ[LICM_OCC];
+	int occ_reg[LICM_OCC];
+	int cnt = 0;
+	int occ_cnt = 0;
+	int wild = 0;
+	int esc = frame_escapes ();
+	int busy = loop_regs (h, t, &wild);
+	int b = h;
+	int i = 0;
+	int e = 0;
+	int k = 0;
+	int n = 0;
+	int r = 0;
+	if (busy < 0) {
+		return 0;
+	}
+	busy = busy | *((int*) live_in + h);
+	while (b <= t) {
+		i = *((int*) blk_sta + b);
+		while ((i < *((int*) blk_end + b)) && (occ_cnt < LICM_OCC)) {
+			if (ins_is_code (i) && ins_invariant (i, h, t, wild, esc)) {
+				e = chain_end (i);
+				if ((e != i) && ((live_after (b, e) | *((int*) live_in + h))
+							& bitmask (LIVE_FLAGS))) {
+					i = e + 1;
+					continue;
+				}
+				k = 0;
+				while ((k < cnt) && !chain_same (*(sta + k), i)) {
+					k = k + 1;
+				}
+				r = LICM_REG;
+				while ((k == cnt) && (r < (LICM_REG + LICM_CNT))
+						&& (busy & bitmask (r))) {
+					r = r + 1;
+				}
+				if ((k == cnt) && (r < (LICM_REG + LICM_CNT))) {
+					busy = busy | bitmask (r);
+					*(sta + cnt) = i;
+					*(reg + cnt) = r;
+					cnt = cnt + 1;
+				}
+				if (k < cnt) {
+					*(occ + occ_cnt) = i;
+					*(occ_reg + occ_cnt) = *(reg + k);
+					occ_cnt = occ_cnt + 1;
+				}
+				i = e;
+			}
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	if (occ_cnt == 0) {
+		return 0;
+	}
+
+	/* Make room in front of the header label */
+	k = 0;
+	while (k < cnt) {
+		n = n + chain_len (*(sta + k));
+		k = k + 1;
+	}
+	if ((ins_cnt + n) > INS_SZ) {
+		return 0;
+	}
+	b = *((int*) blk_sta + h);
+	ins_open (b, n);
+
+	/* Fill the preheader */
+	k = 0;
+	while (k < cnt) {
+		i = *(sta + k) + n;
+		e = chain_end (i);
+		while (1) {
+			ins_copy (b, i, 1);
+			if (ins_get_op (b) == OP_NOT) {
+				*((char*) ins_ar + b) = (char) *(reg + k);
+			} else {
+				*((char*) ins_br + b) = (char) *(reg + k);
+			}
+			b = b + 1;
+			if (i == e) {
+				break;
+			}
+			i = ins_next (i);
+		}
+		k = k + 1;
+	}
+
+	/* Replace computations inside the loop with copies */
+	k = 0;
+	while (k < occ_cnt) {
+		i = *(occ + k) + n;
+		e = chain_end (i);
+		while (i != e) {
+			e = ins_next (i);
+			ins_set_op (e, OP_NOP);
+			e = chain_end (i);
+		}
+		ins_set_op (i, OP_MOV);
+		*((char*) ins_ak + i) = (char) K_REG;
+		*((char*) ins_ar + i) = (char) *(occ_reg + k);
+		k = k + 1;
+	}
+	return 1;
+}
+
+/* Hoists invariant computations out of loops, one loop at a time */
+int opt_licm() {
+	int h = 1;
+	int t = 0;
+	while (h < blk_cnt) {
+		t = loop_end (h);
+		if ((t >= 0) && loop_entry_ok (h, t) && loop_hoist (h, t)) {
+			return 1;
+		}
+		h = h + 1;
+	}
+	return 0;
+}
+
+/* Registers and flags a loop changes */
+int loop_defs(int h, int t) {
+	int i = *((int*) blk_sta + h);
+	int m = 0;
+	while (i < *((int*) blk_end + t)) {
+		m = m | ins_defs (i);
+		i = i + 1;
+	}
+	return m;
+}
+
+/* Finds previous instruction that does something, -1 if none */
+int ins_prev(int i) {
+	i = i - 1;
+	while ((i >= 0) && ins_is_void (i)) {
+		i = i - 1;
+	}
+	return i;
+}
+
+/* Tests if an instruction is movq off(%rbp), %r */
+int ins_loads_slot(int i, int off) {
+	return (ins_get_op (i) == OP_MOV) && ins_is_use (i)
+		&& (*((int*) ins_an + i) == off);
+}
+
+/* Tests if an instruction reads a frame slot in any way */
+int ins_reads_slot(int i, int off) {
+	int op = ins_get_op (i);
+	if (!ins_is_code (i) || (op == OP_LEA)) {
+		return 0;
+	}
+	if (opd_is_based (*((char*) ins_ak + i), *((char*) ins_ar + i),
+				*((char**) ins_as + i), REG_BP)
+			&& (*((int*) ins_an + i) == off)) {
+		return 1;
+	}
+	return ins_is_def (i) && (*((int*) ins_bn + i) == off)
+		&& (op != OP_MOV) && (op != OP_MOVB);
+}
+
+/**
+ * Finds the only store to a frame slot inside a loop, which must
+ * step it by a constant: movq off(%rbp), %r; add $n, %r; movq %r, off(%rbp)
+ *
+ * @param[in] h, t first and last block of the loop
+ * @param[in] off frame slot
+ * @param[out] step the constant
+ * @returns index of the store, -1 if the slot is no induction variable
+ */
+int iv_update(int h, int t, int off, int *step) {
+	int i = *((int*) blk_sta + h);
+	int s = 0 - 1;
+	int p = 0;
+	int r = 0;
+	if (slot_escapes (off)) {
+		return 0 - 1;
+	}
+	while (i < *((int*) blk_end + t)) {
+		if (ins_is_def (i) && (*((int*) ins_bn + i) == off)) {
+			if (s >= 0) {
+				return 0 - 1;
+			}
+			s = i;
+		}
+		i = i + 1;
+	}
+	if ((s < 0) || (ins_get_op (s) != OP_MOV)
+			|| (*((char*) ins_ak + s) != K_REG)) {
+		return 0 - 1;
+	}
+	r = *((char*) ins_ar + s);
+	p = ins_prev (s);
+	if ((p < 0) || ((ins_get_op (p) != OP_ADD) && (ins_get_op (p) != OP_SUB))
+			|| (*((char*) ins_ak + p) != K_IMM)
+			|| (*((char*) ins_bk + p) != K_REG)
+			|| (*((char*) ins_br + p) != r)) {
+		return 0 - 1;
+	}
+	*step = *((int*) ins_an + p);
+	if (ins_get_op (p) == OP_SUB) {
+		*step = 0 - *step;
+	}
+	p = ins_prev (p);
+	if ((p < 0) || !ins_loads_slot (p, off) || (*((char*) ins_br + p) != r)) {
+		return 0 - 1;
+	}
+	return s;
+}
+
+/**
+ * Matches an address computed from an induction variable:
+ * movq %base, %a; movq off(%rbp), %b; [shl $n, %b;] add %b, %a
+ *
+ * @param[in] i index of the first instruction
+ * @param[in] defs registers changed by the loop
+ * @param[out] off frame slot of the variable
+ * @param[out] shift scale of the variable as a power of 2
+ * @returns index of the add, -1 if there is no match
+ */
+int iv_address(int i, int defs, int *off, int *shift) {
+	int a = *((char*) ins_br + i);
+	int r = 0;
+	int j = ins_next (i);
+	if ((ins_get_op (i) != OP_MOV) || (*((char*) ins_ak + i) != K_REG)
+			|| (*((char*) ins_bk + i) != K_REG)
+			|| (defs & bitmask (*((char*) ins_ar + i)))
+			|| (j >= ins_cnt) || !ins_loads_slot (j, *((int*) ins_an + j))) {
+		return 0 - 1;
+	}
+	*off = *((int*) ins_an + j);
+	*shift = 0;
+	r = *((char*) ins_br + j);
+	j = ins_next (j);
+	if ((j < ins_cnt) && (ins_get_op (j) == OP_SHL)
+			&& (*((char*) ins_ak + j) == K_IMM)
+			&& (*((char*) ins_bk + j) == K_REG)
+			&& (*((char*) ins_br + j) == r)) {
+		*shift = *((int*) ins_an + j);
+		j = ins_next (j);
+	}
+	if ((r == a) || (j >= ins_cnt) || (ins_get_op (j) != OP_ADD)
+			|| (*((char*) ins_ak + j) != K_REG)
+			|| (*((char*) ins_ar + j) != r)
+			|| (*((char*) ins_bk + j) != K_REG)
+			|| (*((char*) ins_br + j) != a)) {
+		return 0 - 1;
+	}
+	return j;
+}
+
+/* Tests if a store may be read after the loop it belongs to exits */
+int iv_live_out(int d, int off, int h, int t) {
+	int set[DEF_W];
+	int b = 0;
+	int i = 0;
+	if (set_test ((int*) reach_out + ((h - 1) * DEF_W), d)) {
+		return 1;
+	}
+	while (b < blk_cnt) {
+		if ((b < h) || (b > t)) {
+			set_copy (set, (int*) reach_in + (b * DEF_W));
+			i = *((int*) blk_sta + b);
+			while (i < *((int*) blk_end + b)) {
+				if (ins_reads_slot (i, off) && set_test (set, d)) {
+					return 1;
+				}
+				reach_step (set, i);
+				i = i + 1;
+			}
+		}
+		b = b + 1;
+	}
+	return 0;
+}
+
+/* Picks a register for loop invariants not in a mask, 0 if none */
+int loop_reg(int busy) {
+	int r = LICM_REG;
+	while (r < (LICM_REG + LICM_CNT)) {
+		if (!(busy & bitmask (r))) {
+			return r;
+		}
+		r = r + 1;
+	}
+	return 0;
+}
+
+/* Writes an instruction with a register destination at an index */
+int ins_put(int at, int op, int k, int r, int n, int dst) {
+	char *none = NULL;
+	ins_set_op (at, op);
+	*((char*) ins_cc + at) = (char) 0;
+	*((char*) ins_ak + at) = (char) k;
+	*((char*) ins_ar + at) = (char) r;
+	*((int*) ins_an + at) = n;
+	*((char**) ins_as + at) = none;
+	*((char*) ins_bk + at) = (char) K_REG;
+	*((char*) ins_br + at) = (char) dst;
+	*((int*) ins_bn + at) = 0;
+	*((char**) ins_bs + at) = none;
+	return at + 1;
+}
+
+/* Finds the block holding an instruction */
+int blk_of_ins(int i) {
+	int b = 0;
+	while ((b < blk_cnt) && (*((int*) blk_end + b) <= i)) {
+		b = b + 1;
+	}
+	return b;
+}
+
+/**
+ * Matches a loop test of an induction variable against a bound the
+ * loop does not change: movq off(%rbp), %a; cmp X, %a; jcc
+ *
+ * @param[in] i index of the load
+ * @param[in] off frame slot of the variable
+ * @param[in] defs registers changed by the loop
+ * @param[in] shift scale of the variable as a power of 2
+ * @returns index of the compare, -1 if there is no match
+ */
+int iv_test(int i, int off, int defs, int shift) {
+	int j = ins_next (i);
+	int k = 0;
+	if (!ins_loads_slot (i, off) || (j >= ins_cnt)
+			|| (ins_get_op (j) != OP_CMP)
+			|| (*((char*) ins_bk + j) != K_REG)
+			|| (*((char*) ins_br + j) != *((char*) ins_br + i))
+			|| (ins_get_op (ins_next (j)) != OP_JCC)) {
+		return 0 - 1;
+	}
+	k = *((char*) ins_ak + j);
+	if ((k == K_IMM)
+			&& fold_fits (*((int*) ins_an + j), FOLD_LIM / bitmask (shift))) {
+		return j;
+	}
+	if ((k == K_REG) && !(defs & bitmask (*((char*) ins_ar + j)))) {
+		return j;
+	}
+	return 0 - 1;
+}
+
+/**
+ * Reduces addresses computed from an induction variable of a loop
+ * to a register that steps along with the variable. When the loop test
+ * can compare that register instead, and the variable is not read
+ * after the loop, the variable itself is dropped.
+ *
+ * @param[in] h, t first and last block of the loop
+ * @returns 1 if code was changed
+ */
+int loop_reduce(int h, int t) {
+	int wild = 0;
+	int busy = loop_regs (h, t, &wild);
+	int defs = loop_defs (h, t);
+	int i = *((int*) blk_sta + h);
+	int j = 0;
+	int b = 0;
+	int e = 0;
+	int off = 0;
+	int shift = 0;
+	int base = 0;
+	int step = 0;
+	int s = 0 - 1;
+	int p = 0;
+	int q = 0;
+	int cmp = 0 - 1;
+	int bound = 0;
+	int n = 0;
+	int pre = 0;
+	if ((busy < 0) || (*((int*) live_in + h) & bitmask (LIVE_FLAGS))) {
+		return 0;
+	}
+	busy = busy | *((int*) live_in + h);
+	p = loop_reg (busy);
+	q = loop_reg (busy | bitmask (p));
+	if (!p || ((ins_cnt + 8) > INS_SZ)) {
+		return 0;
+	}
+
+	/* Find an address computed from an induction variable */
+	while ((s < 0) && (i < *((int*) blk_end + t))) {
+		if (ins_is_code (i) && (iv_address (i, defs, &off, &shift) >= 0)) {
+			s = iv_update (h, t, off, &step);
+			base = *((char*) ins_ar + i);
+			if ((shift > 3)
+					|| !fold_fits (step, FOLD_LIM / bitmask (shift))) {
+				s = 0 - 1;
+			}
+		}
+		i = i + 1;
+	}
+	if (s < 0) {
+		return 0;
+	}
+
+	/* Replace matching computations with copies of the register */
+	i = *((int*) blk_sta + h);
+	while (i < *((int*) blk_end + t)) {
+		e = 0 - 1;
+		if (ins_is_code (i)) {
+			e = iv_address (i, defs, &j, &b);
+		}
+		if ((e >= 0) && (j == off) && (b == shift)
+				&& (*((char*) ins_ar + i) == base)
+				&& !(live_after (blk_of_ins (e), e)
+					& (bitmask (LIVE_FLAGS)
+						| bitmask (*((char*) ins_ar + e))))) {
+			*((char*) ins_ar + i) = (char) p;
+			while (i < e) {
+				i = i + 1;
+				if (ins_is_code (i)) {
+					ins_set_op (i, OP_NOP);
+				}
+			}
+			n = n + 1;
+		}
+		i = i + 1;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	/* Let the loop test compare the register too */
+	i = *((int*) blk_sta + h);
+	while (q && (cmp < 0) && (i < *((int*) blk_end + t))) {
+		if (ins_is_code (i)) {
+			cmp = iv_test (i, off, defs, shift);
+		}
+		i = i + 1;
+	}
+	if (cmp >= 0) {
+		i = ins_prev (cmp);
+		*((char*) ins_ak + i) = (char) K_REG;
+		*((char*) ins_ar + i) = (char) p;
+		bound = *((char*) ins_ak + cmp);
+		*((char*) ins_ak + cmp) = (char) K_REG;
+		j = *((char*) ins_ar + cmp);
+		*((char*) ins_ar + cmp) = (char) q;
+		b = *((int*) ins_an + cmp) * bitmask (shift);
+
+		/* Without other reads the variable is not needed */
+		e = ins_prev (ins_prev (s));
+		i = *((int*) blk_sta + h);
+		while ((i < *((int*) blk_end + t))
+				&& ((i == e) || !ins_reads_slot (i, off))) {
+			i = i + 1;
+		}
+		if ((i == *((int*) blk_end + t))
+				&& !iv_live_out (def_of (s), off, h, t)
+				&& !(live_after (blk_of_ins (s), s)
+					& (bitmask (LIVE_FLAGS)
+						| bitmask (*((char*) ins_ar + s))))) {
+			ins_set_op (e, OP_NOP);
+			ins_set_op (ins_prev (s), OP_NOP);
+			ins_set_op (s, OP_NOP);
+		}
+	}
+
+	/* Step the register right after the variable */
+	ins_open (s + 1, 1);
+	ins_put (s + 1, OP_LEA, K_MEM, p, step * bitmask (shift), p);
+
+	/* Set it up in the preheader */
+	n = 2;
+	if (shift) {
+		n = 3;
+	}
+	if ((cmp >= 0) && (bound == K_IMM)) {
+		n = n + 1;
+	} else if (cmp >= 0) {
+		n = n + n;
+	}
+	pre = *((int*) blk_sta + h);
+	ins_open (pre, n);
+	pre = ins_put (pre, OP_MOV, K_MEM, REG_BP, off, p);
+	if (shift) {
+		pre = ins_put (pre, OP_SHL, K_IMM, 0, shift, p);
+	}
+	pre = ins_put (pre, OP_ADD, K_REG, base, 0, p);
+	if ((cmp >= 0) && (bound == K_IMM)) {
+		pre = ins_put (pre, OP_LEA, K_MEM, base, b, q);
+	} else if (cmp >= 0) {
+		pre = ins_put (pre, OP_MOV, K_REG, j, 0, q);
+		if (shift) {
+			pre = ins_put (pre, OP_SHL, K_IMM, 0, shift, q);
+		}
+		pre = ins_put (pre, OP_ADD, K_REG, base, 0, q);
+	}
+	return 1;
+}
+
+/* Strength-reduces induction variables, one loop at a time */
+int opt_ivs() {
+	int h = 1;
+	int t = 0;
+	while (h < blk_cnt) {
+		t = loop_end (h);
+		if ((t >= 0) && loop_entry_ok (h, t) && loop_reduce (h, t)) {
+			return 1;
+		}
+		h = h + 1;
+	}
+	return 0;
+}
+
+/**
+ * Counts reads of a frame slot inside a loop, or finds out the slot
+ * can not be kept in a register there: it is accessed as a byte or
+ * changed by an instruction that has no register form.
+ *
+ * @param[in] h, t first and last block of the loop
+ * @param[in] off frame slot
+ * @param[out] defs number of stores to the slot
+ * @returns number of reads, -1 if the slot has to stay in memory
+ */
+int slot_reads(int h, int t, int off, int *defs) {
+	int i = *((int*) blk_sta + h);
+	int op = 0;
+	int n = 0;
+	*defs = 0;
+	while (i < *((int*) blk_end + t)) {
+		op = ins_get_op (i);
+		if (!ins_is_code (i)) {
+			/* Labels and comments */
+		} else if (opd_is_based (*((char*) ins_ak + i), *((char*) ins_ar + i),
+					*((char**) ins_as + i), REG_BP)
+				&& (*((int*) ins_an + i) == off)) {
+			if ((op == OP_MOVZB) || (op == OP_LEA) || (op == OP_NOT)) {
+				return 0 - 1;
+			}
+			n = n + 1;
+		} else if (ins_is_def (i) && (*((int*) ins_bn + i) == off)) {
+			if ((op == OP_MOVB) || (op == OP_SETCC)) {
+				return 0 - 1;
+			}
+			if ((op != OP_CMP) && (op != OP_TEST)) {
+				*defs = *defs + 1;
+			}
+			if (op != OP_MOV) {
+				n = n + 1;
+			}
+		}
+		i = i + 1;
+	}
+	return n;
+}
+
+/* Tests if stores to a frame slot inside a loop may be read after it */
+int slot_live_out(int h, int t, int off) {
+	int i = *((int*) blk_sta + h);
+	int d = 0;
+	while (i < *((int*) blk_end + t)) {
+		if (ins_is_def (i) && (*((int*) ins_bn + i) == off)
+				&& (ins_get_op (i) != OP_CMP) && (ins_get_op (i) != OP_TEST)) {
+			d = def_of (i);
+			if ((d < 0) || iv_live_out (d, off, h, t)) {
+				return 1;
+			}
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * Keeps the local variable a loop reads most in a register for the
+ * duration of the loop. The register is loaded in a preheader and
+ * takes the place of the frame slot inside the loop. Stores to the
+ * slot are kept after the register is set, unless nothing after the
+ * loop reads them.
+ *
+ * @param[in] h, t first and last block of the loop
+ * @returns 1 if code was changed
+ */
+int loop_promote(int h, int t) {
+	int wild = 0;
+	int busy = loop_regs (h, t, &wild);
+	int i = 0;
+	int n = 0;
+	int cnt = 0;
+	int off = 0;
+	int defs = 0;
+	int keep = 0;
+	int r = 0;
+	if ((busy < 0) || frame_escapes ()) {
+		return 0;
+	}
+	r = loop_reg (busy | *((int*) live_in + h));
+	if (!r) {
+		return 0;
+	}
+	i = *((int*) blk_sta + h);
+	while (i < *((int*) blk_end + t)) {
+		if (ins_is_use (i) && (*((int*) ins_an + i) != off)) {
+			n = slot_reads (h, t, *((int*) ins_an + i), &defs);
+			if (n > cnt) {
+				cnt = n;
+				off = *((int*) ins_an + i);
+			}
+		}
+		i = i + 1;
+	}
+	if (cnt == 0) {
+		return 0;
+	}
+	slot_reads (h, t, off, &defs);
+	keep = slot_live_out (h, t, off);
+	if ((ins_cnt + 1 + (keep * defs)) > INS_SZ) {
+		return 0;
+	}
+
+	/* Replace the slot, going backwards so that stores fit in */
+	i = *((int*) blk_end + t) - 1;
+	while (i >= *((int*) blk_sta + h)) {
+		if (!ins_is_code (i)) {
+			/* Labels and comments */
+		} else if (opd_is_based (*((char*) ins_ak + i), *((char*) ins_ar + i),
+					*((char**) ins_as + i), REG_BP)
+				&& (*((int*) ins_an + i) == off)) {
+			*((char*) ins_ak + i) = (char) K_REG;
+			*((char*) ins_ar + i) = (char) r;
+			*((int*) ins_an + i) = 0;
+		} else if (ins_is_def (i) && (*((int*) ins_bn + i) == off)) {
+			*((char*) ins_bk + i) = (char) K_REG;
+			*((char*) ins_br + i) = (char) r;
+			*((int*) ins_bn + i) = 0;
+			if (keep && (ins_get_op (i) != OP_CMP)
+					&& (ins_get_op (i) != OP_TEST)) {
+				ins_open (i + 1, 1);
+				ins_put (i + 1, OP_MOV, K_REG, r, 0, 0);
+				*((char*) ins_bk + i + 1) = (char) K_MEM;
+				*((char*) ins_br + i + 1) = (char) REG_BP;
+				*((int*) ins_bn + i + 1) = off;
+			}
+		}
+		i = i - 1;
+	}
+
+	/* Load it in front of the header label */
+	i = *((int*) blk_sta + h);
+	ins_open (i, 1);
+	ins_put (i, OP_MOV, K_MEM, REG_BP, off, r);
+	return 1;
+}
+
+/* Keeps local variables in registers, one loop at a time */
+int opt_promote() {
+	int h = 1;
+	int t = 0;
+	while (h < blk_cnt) {
+		t = loop_end (h);
+		if ((t >= 0) && loop_entry_ok (h, t) && loop_promote (h, t)) {
+			return 1;
+		}
+		h = h + 1;
+	}
+	return 0;
+}
+
+/******************************************************************************
+* Loop vectorizer                                                             *
+******************************************************************************/
+
+/* Gives a followed value a constant */
+int sv_const(int v, int c) {
+	*((char*) sv_kind + v) = (char) SV_AFF;
+	*((int*) sv_c + v) = c;
+	*((int*) sv_b1 + v) = 0 - 1;
+	*((int*) sv_n1 + v) = 0;
+	*((int*) sv_b2 + v) = 0 - 1;
+	*((int*) sv_n2 + v) = 0;
+	return 1;
+}
+
+/* Gives a location the value it has when the loop starts */
+int sv_start(int v) {
+	sv_const (v, 0);
+	*((int*) sv_b1 + v) = v;
+	*((int*) sv_n1 + v) = 1;
+	return 1;
+}
+
+/* Copies a followed value */
+int sv_copy(int d, int s) {
+	*((char*) sv_kind + d) = *((char*) sv_kind + s);
+	*((int*) sv_c + d) = *((int*) sv_c + s);
+	*((int*) sv_b1 + d) = *((int*) sv_b1 + s);
+	*((int*) sv_n1 + d) = *((int*) sv_n1 + s);
+	*((int*) sv_b2 + d) = *((int*) sv_b2 + s);
+	*((int*) sv_n2 + d) = *((int*) sv_n2 + s);
+	return 1;
+}
+
+/* Forgets a value whose numbers grow too large to be folded safely */
+int sv_fits(int v) {
+	if (!fold_fits (*((int*) sv_c + v), FOLD_LIM)
+			|| !fold_fits (*((int*) sv_n1 + v), FOLD_MUL)
+			|| !fold_fits (*((int*) sv_n2 + v), FOLD_MUL)) {
+		*((char*) sv_kind + v) = (char) 0;
+	}
+	return 1;
+}
+
+/* Adds n times the starting value of location b to a followed value,
+ * which is forgotten if it would need a third term */
+int sv_term(int v, int b, int n) {
+	if ((n == 0) || (b < 0)) {
+		return 1;
+	}
+	if (*((int*) sv_b1 + v) == b) {
+		*((int*) sv_n1 + v) = *((int*) sv_n1 + v) + n;
+	} else if (*((int*) sv_b2 + v) == b) {
+		*((int*) sv_n2 + v) = *((int*) sv_n2 + v) + n;
+	} else if (*((int*) sv_n1 + v) == 0) {
+		*((int*) sv_b1 + v) = b;
+		*((int*) sv_n1 + v) = n;
+	} else if (*((int*) sv_n2 + v) == 0) {
+		*((int*) sv_b2 + v) = b;
+		*((int*) sv_n2 + v) = n;
+	} else {
+		*((char*) sv_kind + v) = (char) 0;
+	}
+	return 1;
+}
+
+/* Adds a followed value to another one, or subtracts it with sign -1 */
+int sv_add(int d, int s, int sign) {
+	if ((*((char*) sv_kind + d) != SV_AFF) || (*((char*) sv_kind + s) != SV_AFF)) {
+		*((char*) sv_kind + d) = (char) 0;
+		return 1;
+	}
+	*((int*) sv_c + d) = *((int*) sv_c + d) + (sign * *((int*) sv_c + s));
+	sv_term (d, *((int*) sv_b1 + s), sign * *((int*) sv_n1 + s));
+	sv_term (d, *((int*) sv_b2 + s), sign * *((int*) sv_n2 + s));
+	return sv_fits (d);
+}
+
+/* Multiplies a followed value by a constant */
+int sv_scale(int v, int k) {
+	if ((*((char*) sv_kind + v) != SV_AFF) || !fold_fits (k, FOLD_MUL)
+			|| !fold_fits (*((int*) sv_c + v), FOLD_MUL)) {
+		*((char*) sv_kind + v) = (char) 0;
+		return 1;
+	}
+	*((int*) sv_c + v) = *((int*) sv_c + v) * k;
+	*((int*) sv_n1 + v) = *((int*) sv_n1 + v) * k;
+	*((int*) sv_n2 + v) = *((int*) sv_n2 + v) * k;
+	return sv_fits (v);
+}
+
+/* Finds the location of a frame slot, -1 if there are too many */
+int sv_slot(int off) {
+	int k = 0;
+	while (k < sv_slots) {
+		if (*((int*) sv_off + k) == off) {
+			return REG_CNT + k;
+		}
+		k = k + 1;
+	}
+	if (sv_slots == SV_SLOTS) {
+		return 0 - 1;
+	}
+	*((int*) sv_off + k) = off;
+	sv_slots = sv_slots + 1;
+	sv_start (REG_CNT + k);
+	return REG_CNT + k;
+}
+
+/* Finds the location an operand names, -1 if it is no register or slot */
+int sv_loc(int k, int r, int n, char *s) {
+	if (k == K_REG) {
+		return r;
+	}
+	if (opd_is_based (k, r, s, REG_BP)) {
+		return sv_slot (n);
+	}
+	return 0 - 1;
+}
+
+/**
+ * Follows the value of a source operand
+ *
+ * @param[in] v value to set
+ * @param[in] k, r, n, s the operand
+ * @param[in] load kind of value loaded from memory, 0 to not follow it
+ * @returns 1
+ */
+int sv_opd(int v, int k, int r, int n, char *s, int load) {
+	int l = sv_loc (k, r, n, s);
+	*((char*) sv_kind + v) = (char) 0;
+	if (l >= 0) {
+		sv_copy (v, l);
+	} else if (k == K_IMM) {
+		sv_const (v, n);
+	} else if ((k == K_MEM) && (r < REG_CNT) && (r != REG_BP) && (s == NULL)
+			&& load) {
+		sv_copy (v, r);
+		if (*((char*) sv_kind + v) == SV_AFF) {
+			*((int*) sv_c + v) = *((int*) sv_c + v) + n;
+			sv_fits (v);
+		}
+		if (*((char*) sv_kind + v) == SV_AFF) {
+			*((char*) sv_kind + v) = (char) load;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Follows values over an instruction of a loop
+ *
+ * @param[in] i index of the instruction
+ * @param[in,out] size size of the store through a pointer met so far
+ * @returns 0 if the instruction does something a vector loop can not
+ */
+int sv_step(int i, int *size) {
+	int op = ins_get_op (i);
+	int ak = *((char*) ins_ak + i);
+	int ar = *((char*) ins_ar + i);
+	int an = *((int*) ins_an + i);
+	char *as = *((char**) ins_as + i);
+	int bk = *((char*) ins_bk + i);
+	int br = *((char*) ins_br + i);
+	int bn = *((int*) ins_bn + i);
+	int d = 0;
+	int m = 0;
+	int r = 0;
+	if (ins_is_void (i) || (op == OP_LABEL) || (op == OP_JMP)
+			|| (op == OP_JCC) || (op == OP_CMP) || (op == OP_TEST)) {
+		return 1;
+	}
+	if (!ins_is_code (i) || (op == OP_PUSH) || (op == OP_POP)
+			|| (op == OP_CALL) || (op == OP_RET) || (op >= OP_REP)) {
+		return 0;
+	}
+	if ((bk == K_MEM) && (br != REG_BP)) {
+		/* The one store through a pointer */
+		if (((op != OP_MOV) && (op != OP_MOVB)) || (br >= REG_CNT)
+				|| (*((char**) ins_bs + i) != NULL) || *size) {
+			return 0;
+		}
+		*size = 8;
+		if (op == OP_MOVB) {
+			*size = 1;
+		}
+		sv_copy (SV_ADDR, br);
+		sv_const (SV_A, bn);
+		sv_add (SV_ADDR, SV_A, 1);
+		sv_opd (SV_VAL, ak, ar, an, as, 0);
+		return 1;
+	}
+	if (bk != K_NONE) {
+		d = sv_loc (bk, br, bn, *((char**) ins_bs + i));
+		if (d < 0) {
+			return 0;
+		}
+	} else if ((op == OP_NOT) && (ak != K_REG)) {
+		return 0;
+	}
+
+	/* Work out the new value */
+	*((char*) sv_kind + SV_A) = (char) 0;
+	if ((op == OP_MOV) || (op == OP_MOVABS)) {
+		sv_opd (SV_A, ak, ar, an, as, SV_LOADQ);
+	} else if ((op == OP_MOVZB) && (ak == K_MEM) && (ar != REG_BP)) {
+		sv_opd (SV_A, ak, ar, an, as, SV_LOADB);
+	} else if ((op == OP_LEA) && (ak == K_MEM) && (ar < REG_CNT) && (as == NULL)) {
+		sv_copy (SV_A, ar);
+		sv_const (SV_B, an);
+		sv_add (SV_A, SV_B, 1);
+	} else if ((op == OP_LEA) && (ak == K_IDX)) {
+		sv_copy (SV_A, ar);
+		sv_scale (SV_A, an + 1);
+	} else if ((op == OP_ADD) || (op == OP_SUB)) {
+		sv_copy (SV_A, d);
+		sv_opd (SV_B, ak, ar, an, as, 0);
+		sv_add (SV_A, SV_B, 1 - (2 * (op == OP_SUB)));
+	} else if ((op == OP_IMUL) && (ak == K_IMM)) {
+		sv_copy (SV_A, d);
+		sv_scale (SV_A, an);
+	} else if ((op == OP_SHL) && (ak == K_IMM) && (an < 15)) {
+		sv_copy (SV_A, d);
+		sv_scale (SV_A, bitmask (an));
+	} else if ((op == OP_XOR) && (ak == K_REG) && (bk == K_REG) && (ar == br)) {
+		sv_const (SV_A, 0);
+	}
+
+	/* Registers the instruction clobbers are lost but the result */
+	m = ins_defs (i);
+	while (r < REG_CNT) {
+		if (m & bitmask (r)) {
+			*((char*) sv_kind + r) = (char) 0;
+		}
+		r = r + 1;
+	}
+	if (bk != K_NONE) {
+		sv_copy (d, SV_A);
+	}
+	return 1;
+}
+
+/* Finds the step of a location over an iteration, 0 if it is not
+ * its starting value plus a constant */
+int sv_steps(int v, int *inc) {
+	if ((*((char*) sv_kind + v) != SV_AFF)
+			|| !(((*((int*) sv_b1 + v) == v) && (*((int*) sv_n1 + v) == 1)
+					&& (*((int*) sv_n2 + v) == 0))
+				|| ((*((int*) sv_b2 + v) == v) && (*((int*) sv_n2 + v) == 1)
+					&& (*((int*) sv_n1 + v) == 0)))
+			|| !fold_fits (*((int*) sv_c + v), FOLD_MUL)) {
+		return 0;
+	}
+	*inc = *((int*) sv_c + v);
+	return 1;
+}
+
+/* Tests if a followed value reads none of the frame slots in a mask */
+int sv_reads_none(int v, int mask) {
+	int b = *((int*) sv_b1 + v);
+	if (*((int*) sv_n1 + v) && (b >= REG_CNT) && (mask & bitmask (b - REG_CNT))) {
+		return 0;
+	}
+	b = *((int*) sv_b2 + v);
+	return !(*((int*) sv_n2 + v) && (b >= REG_CNT) && (mask & bitmask (b - REG_CNT)));
+}
+
+/* Finds how much a followed value changes over an iteration */
+int sv_delta(int v) {
+	int d = 0;
+	if (*((int*) sv_n1 + v)) {
+		d = *((int*) sv_n1 + v) * *((int*) sv_inc + *((int*) sv_b1 + v));
+	}
+	if (*((int*) sv_n2 + v)) {
+		d = d + (*((int*) sv_n2 + v) * *((int*) sv_inc + *((int*) sv_b2 + v)));
+	}
+	return d;
+}
+
+/* Writes an instruction reading a location to a register */
+int sv_put_loc(int at, int op, int v, int dst) {
+	if (v < REG_CNT) {
+		return ins_put (at, op, K_REG, v, 0, dst);
+	}
+	return ins_put (at, op, K_MEM, REG_BP, *((int*) sv_off + v - REG_CNT), dst);
+}
+
+/* Writes code computing a followed value from current values of
+ * locations to a register, using another one on the way */
+int sv_put(int at, int v, int dst, int tmp) {
+	int b = *((int*) sv_b1 + v);
+	int n = *((int*) sv_n1 + v);
+	int b2 = *((int*) sv_b2 + v);
+	int n2 = *((int*) sv_n2 + v);
+	if ((n == 0) || ((n < 0) && (n2 > 0))) {
+		b = b2;
+		n = n2;
+		b2 = *((int*) sv_b1 + v);
+		n2 = *((int*) sv_n1 + v);
+	}
+	if (n == 0) {
+		return ins_put (at, OP_MOV, K_IMM, 0, *((int*) sv_c + v), dst);
+	}
+	at = sv_put_loc (at, OP_MOV, b, dst);
+	if (n != 1) {
+		at = ins_put (at, OP_IMUL, K_IMM, 0, n, dst);
+	}
+	if (n2 == (0 - 1)) {
+		at = sv_put_loc (at, OP_SUB, b2, dst);
+	} else if (n2) {
+		at = sv_put_loc (at, OP_MOV, b2, tmp);
+		if (n2 != 1) {
+			at = ins_put (at, OP_IMUL, K_IMM, 0, n2, tmp);
+		}
+		at = ins_put (at, OP_ADD, K_REG, tmp, 0, dst);
+	}
+	if (*((int*) sv_c + v)) {
+		at = ins_put (at, OP_ADD, K_IMM, 0, *((int*) sv_c + v), dst);
+	}
+	return at;
+}
+
+/* Writes a label, a line of text or a jump to a label */
+int sv_put_label(int at, int op, int cc, char *name) {
+	ins_put (at, op, K_SYM, 0, 0, 0);
+	*((char*) ins_cc + at) = (char) cc;
+	*((char**) ins_as + at) = name;
+	*((char*) ins_bk + at) = (char) K_NONE;
+	return at + 1;
+}
+
+/* Writes a vector move between a register and memory at a pointer */
+int sv_put_vec(int at, int vec, int ptr, int store) {
+	if (store) {
+		ins_put (at, OP_VMOV, K_VEC, vec, 0, 0);
+		*((char*) ins_bk + at) = (char) K_MEM;
+		*((char*) ins_br + at) = (char) ptr;
+	} else {
+		ins_put (at, OP_VMOV, K_MEM, ptr, 0, 0);
+		*((char*) ins_bk + at) = (char) K_VEC;
+		*((char*) ins_br + at) = (char) vec;
+	}
+	return at + 1;
+}
+
+/**
+ * Follows values over a loop, which has a header block ending with
+ * its test and a body block of one store through a pointer
+ *
+ * @param[in] h header block
+ * @param[out] size size of the store
+ * @returns index of the jump leaving the loop, -1 if it does not fit
+ */
+int sv_follow(int h, int *size) {
+	int i = *((int*) blk_sta + h);
+	int e = *((int*) blk_end + h) - 1;
+	int c = ins_prev (e);
+	int v = 0;
+	sv_slots = 0;
+	while (v < REG_CNT) {
+		sv_start (v);
+		v = v + 1;
+	}
+	*size = 0;
+	if ((ins_get_op (e) != OP_JCC) || (c < i)
+			|| ((ins_get_op (c) != OP_CMP) && (ins_get_op (c) != OP_TEST))
+			|| (ins_get_op (*((int*) blk_end + h + 1) - 1) != OP_JMP)) {
+		return 0 - 1;
+	}
+	while (i < c) {
+		if (!sv_step (i, size)) {
+			return 0 - 1;
+		}
+		i = i + 1;
+	}
+
+	/* The test compares destination to source, or source to zero */
+	if (ins_get_op (c) == OP_CMP) {
+		sv_opd (SV_D, *((char*) ins_bk + c), *((char*) ins_br + c),
+			*((int*) ins_bn + c), *((char**) ins_bs + c), 0);
+		sv_opd (SV_B, *((char*) ins_ak + c), *((char*) ins_ar + c),
+			*((int*) ins_an + c), *((char**) ins_as + c), 0);
+		sv_add (SV_D, SV_B, 0 - 1);
+	} else if ((*((char*) ins_ak + c) == K_REG)
+			&& (*((char*) ins_bk + c) == K_REG)
+			&& (*((char*) ins_ar + c) == *((char*) ins_br + c))) {
+		sv_copy (SV_D, *((char*) ins_ar + c));
+	} else {
+		return 0 - 1;
+	}
+
+	/* Then the body */
+	i = *((int*) blk_sta + h + 1);
+	while (i < *((int*) blk_end + h + 1)) {
+		if (!sv_step (i, size)) {
+			return 0 - 1;
+		}
+		i = i + 1;
+	}
+	if (*size == 0) {
+		return 0 - 1;
+	}
+	return e;
+}
+
+/**
+ * Turns a loop filling or copying memory one byte or quadword at a
+ * time into a loop doing it a vector register at a time. The vector
+ * loop goes in front of the header and runs while at least a vector
+ * worth of iterations remain, then the loop itself does the rest.
+ * Copies only take the vector loop if the destination does not start
+ * within a vector after the source.
+ *
+ * @param[in] h, t first and last block of the loop
+ * @returns 1 if code was changed
+ */
+int loop_vectorize(int h, int t) {
+	int wild = 0;
+	int size = 0;
+	int e = 0;
+	int cc = 0;
+	int dd = 0;
+	int copy = 0;
+	int w = 16 + (16 * vec_avx);
+	int k = 0;
+	int v = 0;
+	int n = 0;
+	int m = 0;
+	int calc = 0;
+	int s1 = 0 - 1;
+	int s2 = 0 - 1;
+	int s3 = 0 - 1;
+	int at = 0;
+	char *lv = NULL;
+	char *ld = NULL;
+	char buf[ID_SZ];
+	if ((t != (h + 1)) || (loop_regs (h, t, &wild) < 0)
+			|| (*((int*) live_in + h) & bitmask (LIVE_FLAGS))
+			|| ((ins_cnt + VEC_INS) > INS_SZ) || frame_escapes ()) {
+		return 0;
+	}
+	e = sv_follow (h, &size);
+	if ((e < 0) || (*((int*) blk_next + h) != t)
+			|| ((*((int*) blk_jump + h) >= h) && (*((int*) blk_jump + h) <= t))) {
+		return 0;
+	}
+
+	/* Registers live into the loop must step evenly, slots may also be
+	 * worked out from those, like stores keeping a register in memory */
+	while (v < SV_LOCS) {
+		*((int*) sv_inc + v) = 0;
+		if ((v < REG_CNT) && (*((int*) live_in + h) & bitmask (v))
+				&& !sv_steps (v, (int*) sv_inc + v)) {
+			return 0;
+		}
+		if ((v >= REG_CNT) && (v < (REG_CNT + sv_slots))
+				&& !sv_steps (v, (int*) sv_inc + v)) {
+			calc = calc | bitmask (v - REG_CNT);
+			m = m + 1;
+		}
+		n = n + (*((int*) sv_inc + v) != 0);
+		v = v + 1;
+	}
+	v = REG_CNT;
+	while (v < (REG_CNT + sv_slots)) {
+		if ((calc & bitmask (v - REG_CNT))
+				&& ((*((char*) sv_kind + v) != SV_AFF) || !sv_reads_none (v, calc))) {
+			return 0;
+		}
+		v = v + 1;
+	}
+	k = w / size;
+	cc = *((char*) ins_cc + e);
+	dd = sv_delta (SV_D);
+	if ((n > 8) || (m > 4) || !sv_reads_none (SV_D, calc)
+			|| !sv_reads_none (SV_ADDR, calc) || !sv_reads_none (SV_VAL, calc)
+			|| (*((char*) sv_kind + SV_D) != SV_AFF)
+			|| (*((char*) sv_kind + SV_ADDR) != SV_AFF)
+			|| (sv_delta (SV_ADDR) != size)
+			|| !(((dd == (0 - 1)) && ((cc == CC_LE) || (cc == CC_E) || (cc == CC_L)))
+				|| ((dd == 1) && ((cc == CC_GE) || (cc == CC_E) || (cc == CC_G))))) {
+		return 0;
+	}
+	if (*((char*) sv_kind + SV_VAL) == (SV_LOADB + (size == 8))) {
+		copy = 1;
+		if (sv_delta (SV_VAL) != size) {
+			return 0;
+		}
+	} else if ((*((char*) sv_kind + SV_VAL) != SV_AFF) || sv_delta (SV_VAL)) {
+		return 0;
+	}
+
+	/* Scratch registers the loop does not need on entry */
+	n = 0;
+	while ((n < REG_POOL) && (s3 < 0)) {
+		v = reg_pool (n);
+		if (!(*((int*) live_in + h) & bitmask (v))) {
+			if (s1 < 0) {
+				s1 = v;
+			} else if (s2 < 0) {
+				s2 = v;
+			} else {
+				s3 = v;
+			}
+		}
+		n = n + 1;
+	}
+	if (s3 < 0) {
+		return 0;
+	}
+	new_label (buf);
+	lv = ins_name ("", buf, "");
+	new_label (buf);
+	ld = ins_name ("", buf, "");
+
+	at = *((int*) blk_sta + h);
+	ins_open (at, VEC_INS);
+	if (copy) {
+		at = sv_put (at, SV_ADDR, s1, s3);
+		at = sv_put (at, SV_VAL, s2, s3);
+		at = ins_put (at, OP_MOV, K_REG, s1, 0, s3);
+		at = ins_put (at, OP_SUB, K_REG, s2, 0, s3);
+		at = ins_put (at, OP_CMP, K_IMM, 0, w, s3);
+		at = sv_put_label (at, OP_JCC, CC_GE, lv);
+		at = ins_put (at, OP_CMP, K_IMM, 0, 0, s3);
+		at = sv_put_label (at, OP_JCC, CC_GE, ld);
+	} else {
+		at = sv_put (at, SV_VAL, s3, s1);
+		ins_put (at, OP_VSPLAT, K_REG, s3, 0, 0);
+		*((char*) ins_cc + at) = (char) size;
+		*((char*) ins_bk + at) = (char) K_VEC;
+		*((char*) ins_br + at) = (char) 1;
+		at = at + 1;
+	}
+	at = sv_put_label (at, OP_LABEL, 0, lv);
+	at = sv_put (at, SV_D, s3, s1);
+	if (dd < 0) {
+		at = ins_put (at, OP_CMP, K_IMM, 0, k - (cc == CC_L), s3);
+		at = sv_put_label (at, OP_JCC, CC_L, ld);
+	} else {
+		at = ins_put (at, OP_CMP, K_IMM, 0, (0 - k) + (cc == CC_G), s3);
+		at = sv_put_label (at, OP_JCC, CC_G, ld);
+	}
+	at = sv_put (at, SV_ADDR, s1, s3);
+	if (copy) {
+		at = sv_put (at, SV_VAL, s2, s3);
+		at = sv_put_vec (at, 0, s2, 0);
+		at = sv_put_vec (at, 0, s1, 1);
+	} else {
+		at = sv_put_vec (at, 1, s1, 1);
+	}
+	v = 0;
+	while (v < SV_LOCS) {
+		n = *((int*) sv_inc + v) * k;
+		if (n && (v < REG_CNT)) {
+			at = ins_put (at, OP_ADD, K_IMM, 0, n, v);
+		} else if (n) {
+			at = ins_put (at, OP_ADD, K_IMM, 0, n, 0);
+			*((char*) ins_bk + at - 1) = (char) K_MEM;
+			*((char*) ins_br + at - 1) = (char) REG_BP;
+			*((int*) ins_bn + at - 1) = *((int*) sv_off + v - REG_CNT);
+		}
+		v = v + 1;
+	}
+	v = REG_CNT;
+	while (v < (REG_CNT + sv_slots)) {
+		if (calc & bitmask (v - REG_CNT)) {
+			/* As the last iteration left it */
+			*((int*) sv_c + v) = *((int*) sv_c + v) - sv_delta (v);
+			at = sv_put (at, v, s3, s1);
+			at = ins_put (at, OP_MOV, K_REG, s3, 0, 0);
+			*((char*) ins_bk + at - 1) = (char) K_MEM;
+			*((char*) ins_br + at - 1) = (char) REG_BP;
+			*((int*) ins_bn + at - 1) = *((int*) sv_off + v - REG_CNT);
+		}
+		v = v + 1;
+	}
+	at = sv_put_label (at, OP_JMP, 0, lv);
+	at = sv_put_label (at, OP_LABEL, 0, ld);
+	if (vec_avx) {
+		/* Upper halves left dirty slow down legacy SSE code */
+		at = sv_put_label (at, OP_TEXT, 0, "  vzeroupper");
+	}
+	while (at < (*((int*) blk_sta + h) + VEC_INS)) {
+		ins_set_op (at, OP_NOP);
+		at = at + 1;
+	}
+	return 1;
+}
+
+/* Vectorizes loops, last to first so that blocks before keep numbers */
+int opt_vectorize() {
+	int h = 0;
+	int changed = 0;
+	if (!cfg_build ()) {
+		return 0;
+	}
+	live_solve ();
+	h = blk_cnt - 1;
+	while (h > 0) {
+		if ((loop_end (h) == (h + 1)) && loop_entry_ok (h, h + 1)
+				&& loop_vectorize (h, h + 1)) {
+			changed = 1;
+			if (!cfg_build ()) {
+				return changed;
+			}
+			live_solve ();
+		}
+		h = h - 1;
+	}
+	return changed;
+}
+
+/******************************************************************************
+* Loop layout                                                                 *
+******************************************************************************/
+
+/**
+ * Finds the test at the top of a loop: code from the header label up
+ * to the first branch, which has to be a conditional one
+ *
+ * @param[in] l header label
+ * @param[out] n number of instructions in the test
+ * @returns index of the conditional jump, -1 if the test does not fit
+ */
+int rot_test(int l, int *n) {
+	int i = l + 1;
+	*n = 0;
+	while ((i < ins_cnt) && (*n < ROT_INS)) {
+		if (ins_is_void (i)) {
+			/* Nothing to copy */
+		} else if (!ins_is_code (i) || (ins_get_op (i) == OP_JMP)
+				|| (ins_get_op (i) == OP_RET) || (ins_get_op (i) == OP_JTAB)) {
+			return 0 - 1;
+		} else {
+			*n = *n + 1;
+			if (ins_get_op (i) == OP_JCC) {
+				return i;
+			}
+		}
+		i = i + 1;
+	}
+	return 0 - 1;
+}
+
+/* Aligns code at a label, along with labels placed right before it */
+int rot_align(int l) {
+	int p = ins_prev (l);
+	while ((p >= 0) && (ins_get_op (p) == OP_LABEL)) {
+		l = p;
+		p = ins_prev (p);
+	}
+	if (((p >= 0) && (ins_get_op (p) == OP_TEXT)
+				&& compare_str (*((char**) ins_as + p), " .p2align 4,,10"))
+			|| (ins_cnt == INS_SZ)) {
+		return 0;
+	}
+	ins_open (l, 1);
+	sv_put_label (l, OP_TEXT, 0, " .p2align 4,,10");
+	return 1;
+}
+
+/**
+ * Rotates loops to test at the bottom. A jump back to the header of a
+ * loop right before its exit becomes a copy of the test at the top,
+ * which jumps back into the body while the loop goes on. A pass then
+ * takes one conditional jump instead of a jump and a test jumping over
+ * it. Heads of loops, rotated or not, are aligned.
+ *
+ * @returns 1 if code was changed
+ */
+int ins_rotate() {
+	char lbl[ID_SZ];
+	char *body = NULL;
+	int changed = 0;
+	int i = 0;
+	int l = 0;
+	int c = 0;
+	int k = 0;
+	int m = 0;
+	int n = 0;
+	while (i < ins_cnt) {
+		l = 0 - 1;
+		if ((ins_get_op (i) == OP_JMP) || (ins_get_op (i) == OP_JCC)) {
+			l = ins_of_label (*((char**) ins_as + i));
+		}
+		if ((l < 0) || (l > i)) {
+			i = i + 1;
+			continue;
+		}
+		c = 0 - 1;
+		if (ins_get_op (i) == OP_JMP) {
+			c = rot_test (l, &n);
+		}
+		if ((c >= 0) && ((ins_cnt + n + 2) <= INS_SZ)
+				&& ins_label_follows (i, *((char**) ins_as + c))) {
+			/* The copy of the test takes the place of the jump */
+			ins_open (i + 1, n - 1);
+			k = l + 1;
+			m = i;
+			while (k <= c) {
+				if (!ins_is_void (k)) {
+					ins_copy (m, k, 1);
+					m = m + 1;
+				}
+				k = k + 1;
+			}
+			new_label (lbl);
+			body = ins_name ("", lbl, "");
+			*((char*) ins_cc + m - 1) = (char) cc_not (*((char*) ins_cc + c));
+			*((char**) ins_as + m - 1) = body;
+			/* The body starts after the test at the top */
+			ins_open (c + 1, 2);
+			sv_put_label (c + 1, OP_TEXT, 0, " .p2align 4,,10");
+			sv_put_label (c + 2, OP_LABEL, 0, body);
+			*((char*) ins_cc + c + 2) = *((char*) ins_cc + l);
+			i = m + 2;
+		} else {
+			i = i + 1 + rot_align (l);
+		}
+		changed = 1;
+	}
+	return changed;
+}
+
+/******************************************************************************
+* Profile                                                                     *
+******************************************************************************/
+
+/* Reads the k-th count of the profile, -1 if it has none */
+int prof_count(int k) {
+	char *p = (char*) prof_buf + (k * 8);
+	int v = 0;
+	int i = 4;
+	if (((k + 1) * 8) > prof_len) {
+		return 0 - 1;
+	}
+	if (*(p + 4) || *(p + 5) || *(p + 6) || *(p + 7) || (*(p + 3) & 192)) {
+		return PROF_BIG;
+	}
+	while (i > 0) {
+		i = i - 1;
+		v = (v * 256) + (*(p + i) & 255);
+	}
+	return v;
+}
+
+/* Reads back the counts a program built with -fprofile-generate left,
+ * returns 0 if there are none */
+int prof_load() {
+	int fd = open ("femtoc.prof", 0);
+	int n = 1;
+	int k = 0;
+	if (fd < 0) {
+		return 0;
+	}
+	while ((n > 0) && (prof_len < PROF_SZ)) {
+		n = read (fd, (char*) prof_buf + prof_len, PROF_SZ - prof_len);
+		if (n > 0) {
+			prof_len = prof_len + n;
+		}
+	}
+	close (fd);
+	while (prof_count (k) >= 0) {
+		if (prof_count (k) > prof_max) {
+			prof_max = prof_count (k);
+		}
+		k = k + 1;
+	}
+	return 1;
+}
+
+/**
+ * Gives the point just reached in the code a counter. Programs built
+ * with -fprofile-generate count there, with -fprofile-use the label
+ * placed right before is marked with what the count tells. Inlined
+ * code is skipped, as profiles may change what gets inlined.
+ *
+ * @returns the count, -1 if it is not known
+ */
+int gen_prof() {
+	int n = prof_cnt;
+	int cc = LBL_HOT;
+	if (!prof_mode || inl_vars) {
+		return 0 - 1;
+	}
+	prof_cnt = prof_cnt + 1;
+	if (prof_mode == PROF_GEN) {
+		ins_new (OP_ADD);
+		ins_src (K_IMM, 0, 1, NULL);
+		ins_dst (K_MEM, REG_IP, n * 8, "__prof");
+		return 0 - 1;
+	}
+	n = prof_count (n);
+	if (n == 0) {
+		cc = LBL_COLD;
+	}
+	if ((n >= 0) && (ins_get_op (ins_cnt - 1) == OP_LABEL)) {
+		*((char*) ins_cc + ins_cnt - 1) = (char) cc;
+	}
+	return n;
+}
+
+/* Tests if an instruction may go on to the next one */
+int ins_falls(int i) {
+	int op = ins_get_op (i);
+	return (op != OP_JMP) && (op != OP_RET) && (op != OP_JTAB);
+}
+
+/**
+ * Moves code the profile never reached out of the way, to the end of
+ * the function in a section of its own. A cold part starts at a label
+ * never reached and runs up to a label reached or not known, such as
+ * the function end. Jumps are put where code falls into or out of it.
+ *
+ * @returns 1 if code was changed
+ */
+int ins_split_cold() {
+	int end = ins_cnt;
+	int i = 0;
+	int j = 0;
+	int k = 0;
+	int changed = 0;
+	while (i < end) {
+		if ((ins_get_op (i) != OP_LABEL) || (*((char*) ins_cc + i) != LBL_COLD)) {
+			i = i + 1;
+			continue;
+		}
+		j = i + 1;
+		while ((j < end) && ((ins_get_op (j) != OP_LABEL)
+					|| (*((char*) ins_cc + j) == LBL_COLD))) {
+			j = j + 1;
+		}
+		if ((ins_cnt + (j - i) + 3) > INS_SZ) {
+			return changed;
+		}
+		ins_cnt = sv_put_label (ins_cnt, OP_TEXT, 0, " .pushsection .text.unlikely");
+		ins_copy (ins_cnt, i, j - i);
+		ins_cnt = ins_cnt + (j - i);
+		/* Where it went on, it jumps there now */
+		k = j - 1;
+		while (ins_is_void (k)) {
+			k = k - 1;
+		}
+		if (ins_falls (k) && (j < end)) {
+			ins_cnt = sv_put_label (ins_cnt, OP_JMP, 0, *((char**) ins_as + j));
+		}
+		ins_cnt = sv_put_label (ins_cnt, OP_TEXT, 0, " .popsection");
+		/* Code falling into it jumps there instead */
+		k = i - 1;
+		while (ins_is_void (k)) {
+			k = k - 1;
+		}
+		if (ins_falls (k)) {
+			sv_put_label (i, OP_JMP, 0, *((char**) ins_as + i));
+			i = i + 1;
+		}
+		while (i < j) {
+			ins_set_op (i, OP_NOP);
+			i = i + 1;
+		}
+		changed = 1;
+	}
+	return changed;
+}
+
+/******************************************************************************
+* Tail calls                                                                  *
+******************************************************************************/
+
+/* Finds the instruction holding a label, -1 if there is none */
+int ins_of_label(char *name) {
+	int i = 0;
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_LABEL)
+				&& compare_str (name, *((char**) ins_as + i))) {
+			return i;
+		}
+		i = i + 1;
+	}
+	return 0 - 1;
+}
+
+/* Tests if an instruction belongs to the function epilogue */
+int ins_is_epilogue(int i) {
+	int op = ins_get_op (i);
+	if ((*((char*) ins_bk + i) == K_REG) && (*((char*) ins_br + i) == REG_SP)) {
+		return ((op == OP_MOV) && (*((char*) ins_ak + i) == K_REG)
+				&& (*((char*) ins_ar + i) == REG_BP))
+			|| ((op == OP_LEA) && (*((char*) ins_ak + i) == K_MEM));
+	}
+	/* The base pointer is popped by callees with -abi=sysv */
+	return (op == OP_POP) && ((*((char*) ins_ar + i) == alloc_reg)
+			|| (abi_sysv && (*((char*) ins_ar + i) == REG_BP)));
+}
+
+/**
+ * Tests if the function returns the value of a call right away:
+ * the value may be stored to a frame slot and read back from there,
+ * and jumps are followed on the way to the epilogue.
+ *
+ * @param[in] i index of the first instruction after the call
+ * @returns 1 if the call is in tail position
+ */
+int ins_tail(int i) {
+	int slot = 0;
+	int stored = 0;
+	int steps = 0;
+	int op = 0;
+	while ((i >= 0) && (i < ins_cnt) && (steps < ins_cnt)) {
+		op = ins_get_op (i);
+		if (op == OP_RET) {
+			return 1;
+		}
+		if (op == OP_JMP) {
+			i = ins_of_label (*((char**) ins_as + i));
+		} else if ((op == OP_MOV) && ins_is_def (i)
+				&& (*((char*) ins_ak + i) == K_REG)
+				&& (*((char*) ins_ar + i) == REG_AX)) {
+			slot = *((int*) ins_bn + i);
+			stored = 1;
+			i = i + 1;
+		} else if ((op == OP_MOV) && ins_is_use (i) && stored
+				&& (*((int*) ins_an + i) == slot)
+				&& (*((char*) ins_br + i) == REG_AX)) {
+			i = i + 1;
+		} else if (ins_is_void (i) || (op == OP_LABEL)
+				|| ins_is_epilogue (i)) {
+			i = i + 1;
+		} else {
+			return 0;
+		}
+		steps = steps + 1;
+	}
+	return 0;
+}
+
+/* Tests if the function changes the allocation pointer */
+int fn_allocates() {
+	int i = 0;
+	while (i < ins_cnt) {
+		if ((ins_defs (i) & bitmask (alloc_reg)) && !ins_is_epilogue (i)) {
+			return 1;
+		}
+		i = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * Replaces a call sequence with a jump
+ * Arguments pushed for the call go over those of the function instead,
+ * the stack is unwound and the callee returns straight to our caller.
+ * With -abi=sysv they come in registers, stored for a jump within the
+ * function and left as they are for another one.
+ *
+ * @param[in] i index of the first instruction of the sequence
+ * @param[in] e index of its last instruction
+ * @param[in] n number of arguments
+ * @param[in] name label to jump to
+ * @param[in] sp stack pointer offset from %rbp at the label
+ * @param[in] out the label is another function
+ * @returns 1
+ */
+int ins_tail_jump(int i, int e, int n, char *name, int sp, int out) {
+	int a = 0;
+	int p = ins_prev (i);
+	int k = (n * 2) + 2;
+	int slots = arg_slots (count_vars (arguments) - 1);
+	char *none = NULL;
+	if (abi_sysv) {
+		/* Arguments in registers are stored, or left for the callee
+		 * when the frame is unwound like the epilogue does it */
+		k = n + 2;
+		if (n > ARG_REGS) {
+			k = k + n - ARG_REGS;
+		}
+		if (out) {
+			k = 5 + (slots > 0);
+		}
+	} else {
+		while ((a < n) && (p >= 0) && (ins_get_op (p) == OP_PUSH)) {
+			a = a + 1;
+			p = ins_prev (p);
+		}
+	}
+	if (!abi_sysv && (a == n)) {
+		/* Arguments were pushed right before: store them instead */
+		p = ins_prev (i);
+		a = 0;
+		while (a < n) {
+			ins_set_op (p, OP_MOV);
+			*((char*) ins_bk + p) = (char) K_MEM;
+			*((char*) ins_br + p) = (char) REG_BP;
+			*((int*) ins_bn + p) = (a + 1) * type_sizeof (TYPE_INT);
+			*((char**) ins_bs + p) = none;
+			p = ins_prev (p);
+			a = a + 1;
+		}
+		n = 0;
+		k = 2;
+	}
+	if ((e - i + 1) < k) {
+		ins_open (e + 1, k - (e - i + 1));
+		e = i + k - 1;
+	}
+	a = 0;
+	while (a < n) {
+		if (abi_sysv && (a >= ARG_REGS)) {
+			/* Those past the registers are in the copies on top */
+			i = ins_put (i, OP_MOV, K_MEM, REG_SP,
+					(a - ARG_REGS) * type_sizeof (TYPE_INT), REG_AX);
+			ins_put (i, OP_MOV, K_REG, REG_AX, 0, 0);
+		} else if (abi_sysv) {
+			ins_put (i, OP_MOV, K_REG, arg_reg (a), 0, 0);
+		} else {
+			i = ins_put (i, OP_MOV, K_MEM, REG_SP,
+					a * type_sizeof (TYPE_INT), REG_AX);
+			ins_put (i, OP_MOV, K_REG, REG_AX, 0, 0);
+		}
+		*((char*) ins_bk + i) = (char) K_MEM;
+		*((char*) ins_br + i) = (char) REG_BP;
+		*((int*) ins_bn + i) = (a + 1) * type_sizeof (TYPE_INT);
+		i = i + 1;
+		a = a + 1;
+	}
+	i = ins_put (i, OP_LEA, K_MEM, REG_BP, sp, REG_SP);
+	if (abi_sysv && out) {
+		ins_put (i, OP_POP, K_REG, alloc_reg, 0, 0);
+		*((char*) ins_bk + i) = (char) K_NONE;
+		ins_put (i + 1, OP_POP, K_REG, REG_BP, 0, 0);
+		*((char*) ins_bk + i + 1) = (char) K_NONE;
+		i = i + 2;
+		if (slots > 0) {
+			i = ins_put (i, OP_LEA, K_MEM, REG_SP,
+					slots * type_sizeof (TYPE_INT), REG_SP);
+		}
+		i = ins_put (i, OP_XOR, K_REG, REG_AX, 0, REG_AX);
+	}
+	ins_put (i, OP_JMP, K_SYM, 0, 0, 0);
+	*((char*) ins_cc + i) = (char) out;
+	*((char**) ins_as + i) = name;
+	*((char*) ins_bk + i) = (char) K_NONE;
+	while (i < e) {
+		i = i + 1;
+		ins_set_op (i, OP_NOP);
+	}
+	return 1;
+}
+
+/* Tests if an instruction adds a number to %rsp or subtracts one */
+int ins_moves_sp(int i, int op) {
+	return (i >= 0) && (i < ins_cnt) && (ins_get_op (i) == op)
+		&& (*((char*) ins_ak + i) == K_IMM)
+		&& (*((char*) ins_bk + i) == K_REG)
+		&& (*((char*) ins_br + i) == REG_SP);
+}
+
+/* Tests if a call sequence ending at e drops arguments passed on the
+ * stack, which only -abi=sysv calls with more than ARG_REGS of them do */
+int ins_call_stacks(int e) {
+	return abi_sysv && ins_moves_sp (e, OP_ADD)
+		&& (*((int*) ins_an + e) > type_sizeof (TYPE_INT));
+}
+
+/**
+ * Matches a call sequence: push %rbp; movq %rsp, %rbp; call f;
+ * pop %rbp; add $n, %rsp
+ * With -abi=sysv it is xor %rax, %rax; call f, and the stack may be
+ * aligned around by sub $8, %rsp and add $8, %rsp
+ *
+ * @param[in] c index of the call
+ * @param[out] sta index of the first instruction
+ * @param[out] end index of the last instruction
+ * @returns number of arguments on stack, -1 if there is no match
+ */
+int ins_call_seq(int c, int *sta, int *end) {
+	int i = ins_prev (c);
+	int e = ins_next (c);
+	if (abi_sysv) {
+		if ((ins_get_op (c) != OP_CALL) || (i < 0)
+				|| (ins_get_op (i) != OP_XOR)) {
+			return 0 - 1;
+		}
+		*sta = i;
+		*end = c;
+		if (ins_moves_sp (ins_prev (i), OP_SUB)) {
+			*sta = ins_prev (i);
+		}
+		if (ins_moves_sp (e, OP_ADD)) {
+			*end = e;
+		}
+		return 0;
+	}
+	if ((ins_get_op (c) != OP_CALL) || (i < 0)
+			|| (ins_get_op (i) != OP_MOV) || (e >= ins_cnt)
+			|| (ins_get_op (e) != OP_POP)
+			|| (*((char*) ins_ar + e) != REG_BP)) {
+		return 0 - 1;
+	}
+	i = ins_prev (i);
+	if ((i < 0) || (ins_get_op (i) != OP_PUSH)
+			|| (*((char*) ins_ar + i) != REG_BP)) {
+		return 0 - 1;
+	}
+	*sta = i;
+	*end = e;
+	e = ins_next (e);
+	if (ins_moves_sp (e, OP_ADD)) {
+		*end = e;
+		return *((int*) ins_an + e) / type_sizeof (TYPE_INT);
+	}
+	return 0;
+}
+
+/* Finds the last instruction of the prologue of a function */
+int ins_prologue_end(int l) {
+	int i = ins_next (l);
+	if (abi_sysv) {
+		/* Arguments and base pointer go first, then the allocation
+		 * pointer is saved twice, and main sets it up */
+		while ((ins_get_op (i) != OP_PUSH)
+				|| (*((char*) ins_ar + i) != alloc_reg)) {
+			i = ins_next (i);
+		}
+		i = ins_next (i);
+		if ((ins_get_op (ins_next (i)) == OP_LEA)
+				&& (*((char*) ins_br + ins_next (i)) == alloc_reg)) {
+			i = ins_next (i);
+		}
+	}
+	return i;
+}
+
+/**
+ * Turns calls in tail position into jumps, as long as the function has
+ * room for the arguments of the callee. Calls of the function itself
+ * jump back to the start of its body, making a loop. With -abi=sysv
+ * arguments are passed in registers, so any callee has room for them.
+ *
+ * @param[in] self 1 for calls of the function itself, 0 for the rest
+ * @returns 1 if code was changed
+ */
+int opt_tails(int self) {
+	int argc = count_vars (arguments) - 1;
+	int alloc = fn_allocates ();
+	char *fn = NULL;
+	char *body = NULL;
+	int c = 0;
+	int i = 0;
+	int e = 0;
+	int n = 0;
+	int changed = 0;
+	while ((c < ins_cnt) && (ins_get_op (c) != OP_LABEL)) {
+		c = c + 1;
+	}
+	if (c == ins_cnt) {
+		return 0;
+	}
+	fn = *((char**) ins_as + c);
+	while (c < ins_cnt) {
+		n = ins_call_seq (c, &i, &e);
+		if ((n >= 0) && (n <= argc)
+				&& (compare_str (*((char**) ins_as + c), fn) == self)
+				&& (self || !alloc) && ins_tail (ins_next (e))
+				&& (self || !ins_call_stacks (e))
+				&& ((ins_cnt + (argc * 2) + 6) <= INS_SZ)) {
+			if (self && !body) {
+				/* The loop starts after the allocation pointer is saved */
+				body = ins_name ("__", fn, "_body");
+				n = ins_prologue_end (ins_of_label (fn));
+				ins_open (n + 1, 1);
+				ins_set_op (n + 1, OP_LABEL);
+				*((char**) ins_as + n + 1) = body;
+				c = c + 1;
+				n = ins_call_seq (c, &i, &e);
+			}
+			if (abi_sysv && self) {
+				/* Arguments are stored from registers */
+				n = argc;
+			}
+			if (self) {
+				ins_tail_jump (i, e, n, body, 0 - 16, 0);
+			} else {
+				ins_tail_jump (i, e, n, *((char**) ins_as + c), 0 - 8, 1);
+			}
+			changed = 1;
+		}
+		c = c + 1;
+	}
+	return changed;
+}
+
+/**
+ * Saves loop registers the System V convention has callees preserve.
+ * They are pushed in pairs above the arguments, so that nothing moves
+ * relative to the base pointer and the stack stays aligned, and popped
+ * once the arguments are dropped on the way out.
+ *
+ * @returns 1 if code was changed
+ */
+int ins_save_regs() {
+	int used = 0;
+	int save = 0;
+	int exits = 1;
+	int i = 0;
+	int j = 0;
+	int r = 0;
+	int n = 0;
+	while (i < ins_cnt) {
+		used = used | ins_defs (i);
+		if ((ins_get_op (i) == OP_POP) && (*((char*) ins_ar + i) == REG_BP)) {
+			exits = exits + 1;
+		}
+		i = i + 1;
+	}
+	r = LICM_REG;
+	while (r < (LICM_REG + LICM_CNT)) {
+		if (used & (bitmask (r) | bitmask (r + 1))) {
+			save = save | bitmask (r) | bitmask (r + 1);
+			n = n + 2;
+		}
+		r = r + 2;
+	}
+	if (!n || ((ins_cnt + (n * exits)) > INS_SZ)) {
+		return 0;
+	}
+	i = 0;
+	while (ins_get_op (i) != OP_LABEL) {
+		i = i + 1;
+	}
+	i = i + 1;
+	ins_open (i, n);
+	r = LICM_REG;
+	while (r < (LICM_REG + LICM_CNT)) {
+		if (save & bitmask (r)) {
+			ins_put (i, OP_PUSH, K_REG, r, 0, 0);
+			*((char*) ins_bk + i) = (char) K_NONE;
+			i = i + 1;
+		}
+		r = r + 1;
+	}
+	/* Arguments past the registers are copied from further up now */
+	while ((i < ins_cnt) && (ins_get_op (i) == OP_PUSH)
+			&& (*((char*) ins_ak + i) == K_MEM)) {
+		*((int*) ins_an + i) = *((int*) ins_an + i) + (n * type_sizeof (TYPE_INT));
+		i = i + 1;
+	}
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_POP) && (*((char*) ins_ar + i) == REG_BP)) {
+			/* Arguments are dropped right after */
+			j = ins_next (i);
+			if ((ins_get_op (j) == OP_LEA)
+					&& (*((char*) ins_ar + j) == REG_SP)
+					&& (*((char*) ins_br + j) == REG_SP)) {
+				i = j;
+			}
+			i = i + 1;
+			ins_open (i, n);
+			r = LICM_REG + LICM_CNT;
+			while (r > LICM_REG) {
+				r = r - 1;
+				if (save & bitmask (r)) {
+					ins_put (i, OP_POP, K_REG, r, 0, 0);
+					*((char*) ins_bk + i) = (char) K_NONE;
+					i = i + 1;
+				}
+			}
+		}
+		i = i + 1;
+	}
+	return 1;
+}
+
+/* Tests if an instruction sets the stack pointer from the base pointer */
+int ins_sp_from_bp(int i) {
+	int op = ins_get_op (i);
+	int ak = *((char*) ins_ak + i);
+	return (*((char*) ins_bk + i) == K_REG) && (*((char*) ins_br + i) == REG_SP)
+		&& (*((char*) ins_ar + i) == REG_BP)
+		&& (((op == OP_MOV) && (ak == K_REG)) || ((op == OP_LEA) && (ak == K_MEM)));
+}
+
+/* Tests if an instruction saves or sets up the base pointer,
+ * or saves the allocation pointer */
+int ins_sets_frame(int i) {
+	int op = ins_get_op (i);
+	int r = *((char*) ins_ar + i);
+	if (op == OP_PUSH) {
+		return (r == REG_BP) || (r == alloc_reg);
+	}
+	return (op == OP_MOV) && (*((char*) ins_ak + i) == K_REG) && (r == REG_SP)
+		&& (*((char*) ins_bk + i) == K_REG) && (*((char*) ins_br + i) == REG_BP);
+}
+
+/* Tests if an epilogue instruction is followed by the return */
+int ins_unwinds(int i) {
+	while ((i < ins_cnt) && (ins_is_void (i) || ins_is_epilogue (i))) {
+		i = i + 1;
+	}
+	return (i < ins_cnt) && (ins_get_op (i) == OP_RET);
+}
+
+/* Offset of a frame slot from where the base pointer would be without
+ * the frame: below it there is no return address and saved pointers */
+int frame_off(int off) {
+	if (off > 0) {
+		return off;
+	}
+	return off + (type_sizeof (TYPE_INT) * (2 + abi_sysv));
+}
+
+/* Tests if an operand is a frame slot the function may do without */
+int opd_frame_ok(int k, int r, int n) {
+	if ((k == K_REG) || (k == K_IDX)) {
+		return r != REG_BP;
+	}
+	return (k != K_MEM) || (r != REG_BP) || (n > 0) || (n <= (0 - 24));
+}
+
+/**
+ * Follows the stack pointer over an instruction of a function losing
+ * its frame. The stack pointer is kept as an offset from where the
+ * base pointer would be, so that frame slots are found relative to it.
+ *
+ * @param[in] i instruction index
+ * @param[in] d offset before the instruction
+ * @param[in] pro last instruction of the prologue
+ * @param[in] top offset at the entry, and so at the return
+ * @returns offset after the instruction, 1 if it can not be followed
+ */
+int frame_step(int i, int d, int pro, int top) {
+	int op = ins_get_op (i);
+	int r = *((char*) ins_ar + i);
+	int n = *((int*) ins_an + i);
+	if ((i <= pro) && ins_sets_frame (i)) {
+		return d;
+	}
+	if (ins_is_epilogue (i) && ins_unwinds (i)) {
+		if (ins_sp_from_bp (i)) {
+			return top;
+		}
+		return d;
+	}
+	if ((op == OP_CALL) || (op == OP_ASM)
+			|| ((op == OP_JMP) && *((char*) ins_cc + i))) {
+		return 1;
+	}
+	if (!ins_is_code (i)) {
+		return d;
+	}
+	if ((op == OP_LEA) && (*((char*) ins_br + i) == REG_SP)) {
+		if (r == REG_SP) {
+			return d + n;
+		} else if (r == REG_BP) {
+			return frame_off (n);
+		}
+		return 1;
+	}
+	if (!opd_frame_ok (*((char*) ins_ak + i), r, n)
+			|| !opd_frame_ok (*((char*) ins_bk + i), *((char*) ins_br + i),
+				*((int*) ins_bn + i))
+			|| ((op == OP_LEA) && (*((char*) ins_ak + i) == K_MEM)
+				&& (r == REG_BP))) {
+		return 1;
+	}
+	if (op == OP_PUSH) {
+		return d - type_sizeof (TYPE_INT);
+	}
+	if (op == OP_POP) {
+		if ((r == REG_SP) || (r == REG_BP) || (r == alloc_reg)) {
+			return 1;
+		}
+		return d + type_sizeof (TYPE_INT);
+	}
+	if (!(ins_defs (i) & (bitmask (REG_SP) | bitmask (REG_BP)))) {
+		return d;
+	}
+	if ((*((char*) ins_ak + i) == K_IMM) && (*((char*) ins_br + i) == REG_SP)) {
+		if (op == OP_ADD) {
+			return d + n;
+		} else if (op == OP_SUB) {
+			return d - n;
+		}
+	}
+	return 1;
+}
+
+/* Passes the stack pointer offset on to a block,
+ * returns 0 if it disagrees, 2 if the block gets it first */
+int frame_pass(int b, int d) {
+	if (b < 0) {
+		return 1;
+	}
+	if (*((int*) blk_sp + b) == 1) {
+		*((int*) blk_sp + b) = d;
+		return 2;
+	}
+	return *((int*) blk_sp + b) == d;
+}
+
+/* Finds the stack pointer offset at the start of every block,
+ * returns 0 if some instruction can not be followed */
+int frame_solve(int pro, int top) {
+	int changed = 1;
+	int b = 0;
+	int i = 0;
+	int d = 0;
+	int r = 0;
+	int k = 0;
+	while (b < blk_cnt) {
+		*((int*) blk_sp + b) = 1;
+		b = b + 1;
+	}
+	*((int*) blk_sp) = top;
+	while (changed) {
+		changed = 0;
+		b = 0;
+		while (b < blk_cnt) {
+			d = *((int*) blk_sp + b);
+			i = *((int*) blk_sta + b);
+			while ((d != 1) && (i < *((int*) blk_end + b))) {
+				d = frame_step (i, d, pro, top);
+				if (d == 1) {
+					return 0;
+				}
+				if ((ins_get_op (i) == OP_RET) && (d != top)) {
+					return 0;
+				}
+				i = i + 1;
+			}
+			if (d != 1) {
+				r = frame_pass (*((int*) blk_next + b), d)
+					* frame_pass (*((int*) blk_jump + b), d);
+				k = 0;
+				while (r && (blk_case (b, k) >= 0)) {
+					r = r * frame_pass (blk_case (b, k), d);
+					k = k + 1;
+				}
+				if (!r) {
+					return 0;
+				}
+				changed = changed || (r > 1);
+			}
+			b = b + 1;
+		}
+	}
+	/* Blocks never reached may only be left over from other passes */
+	b = 0;
+	while (b < blk_cnt) {
+		i = *((int*) blk_sta + b);
+		while ((*((int*) blk_sp + b) == 1) && (i < *((int*) blk_end + b))) {
+			if (ins_is_code (i)) {
+				return 0;
+			}
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return 1;
+}
+
+/**
+ * Drops the frame of a leaf function, one that makes no calls, does
+ * not allocate and takes no addresses of its slots. The prologue and
+ * epilogue go away and slots are reached through the stack pointer,
+ * arguments stay where callers put them.
+ *
+ * @param[in] top stack pointer offset from where the base pointer
+ *                would be at the entry
+ * @returns 1 if code was changed
+ */
+int frame_elide(int top) {
+	int pro = 0;
+	int b = 0;
+	int i = 0;
+	int d = 0;
+	int n = 0;
+	if (!cfg_build () || fn_allocates ()) {
+		return 0;
+	}
+	while ((pro < ins_cnt) && (ins_get_op (pro) != OP_LABEL)) {
+		pro = pro + 1;
+	}
+	if (pro == ins_cnt) {
+		return 0;
+	}
+	pro = ins_prologue_end (pro);
+	if (!frame_solve (pro, top)) {
+		return 0;
+	}
+	while (b < blk_cnt) {
+		d = *((int*) blk_sp + b);
+		i = *((int*) blk_sta + b);
+		while ((d != 1) && (i < *((int*) blk_end + b))) {
+			n = frame_step (i, d, pro, top);
+			if (((i <= pro) && ins_sets_frame (i))
+					|| (ins_is_epilogue (i) && ins_unwinds (i))) {
+				/* The stack pointer is restored by what was pushed */
+				if (ins_sp_from_bp (i) && (n != d)) {
+					ins_put (i, OP_LEA, K_MEM, REG_SP, n - d, REG_SP);
+				} else {
+					ins_set_op (i, OP_NOP);
+				}
+			} else if (ins_is_code (i)) {
+				if ((*((char*) ins_ak + i) == K_MEM)
+						&& (*((char*) ins_ar + i) == REG_BP)) {
+					*((char*) ins_ar + i) = (char) REG_SP;
+					*((int*) ins_an + i) = frame_off (*((int*) ins_an + i)) - d;
+				}
+				if ((*((char*) ins_bk + i) == K_MEM)
+						&& (*((char*) ins_br + i) == REG_BP)) {
+					*((char*) ins_br + i) = (char) REG_SP;
+					*((int*) ins_bn + i) = frame_off (*((int*) ins_bn + i)) - d;
+				}
+				if ((n == d) && (ins_get_op (i) == OP_LEA)
+						&& (*((char*) ins_br + i) == REG_SP)) {
+					ins_set_op (i, OP_NOP);
+				}
+			}
+			d = n;
+			i = i + 1;
+		}
+		b = b + 1;
+	}
+	return 1;
+}
+
+/* Frame slot of a local behind an operand, -1 if it is none */
+int slot_of(int k, int r, int n, char *s) {
+	if (!opd_is_based (k, r, s, REG_BP) || (n > (0 - 24))) {
+		return 0 - 1;
+	}
+	return ((0 - n) / type_sizeof (TYPE_INT)) - 3;
+}
+
+/* Tests if the locals of a function are reached in ways slot_step
+ * follows: as whole aligned slots of the frame reserved by sub */
+int slot_check(int frame) {
+	int m = *((int*) ins_an + frame) / type_sizeof (TYPE_INT);
+	int i = 0;
+	int op = 0;
+	int a = 0;
+	int b = 0;
+	if (m > SLOT_SZ) {
+		return 0;
+	}
+	while (i < ins_cnt) {
+		op = ins_get_op (i);
+		a = slot_of (*((char*) ins_ak + i), *((char*) ins_ar + i),
+				*((int*) ins_an + i), *((char**) ins_as + i));
+		b = slot_of (*((char*) ins_bk + i), *((char*) ins_br + i),
+				*((int*) ins_bn + i), *((char**) ins_bs + i));
+		if ((op == OP_ASM) || (ins_is_code (i) && ((a >= m) || (b >= m)
+				|| ((a >= 0) && ((op == OP_POP) || (op == OP_NOT)
+						|| (op == OP_LEA)
+						|| ((0 - *((int*) ins_an + i)) % type_sizeof (TYPE_INT))))
+				|| ((b >= 0)
+					&& ((0 - *((int*) ins_bn + i)) % type_sizeof (TYPE_INT)))
+				|| ((*((char*) ins_ak + i) == K_IDX)
+					&& (*((char*) ins_ar + i) == REG_BP))
+				|| ((*((char*) ins_bk + i) == K_IDX)
+					&& (*((char*) ins_br + i) == REG_BP))))) {
+			return 0;
+		}
+		i = i + 1;
+	}
+	return 1;
+}
+
+/* Frame slots live before an instruction given those after it */
+int slot_step(int *set, int i) {
+	int op = ins_get_op (i);
+	int k = slot_of (*((char*) ins_bk + i), *((char*) ins_br + i),
+			*((int*) ins_bn + i), *((char**) ins_bs + i));
+	if (!ins_is_code (i)) {
+		return 1;
+	}
+	if ((k >= 0) && ((op == OP_MOV) || (op == OP_MOVB))) {
+		*(set + (k / SET_BITS)) = *(set + (k / SET_BITS)) & ~bitmask (k % SET_BITS);
+	} else if (k >= 0) {
+		set_add (set, k);
+	}
+	k = slot_of (*((char*) ins_ak + i), *((char*) ins_ar + i),
+			*((int*) ins_an + i), *((char**) ins_as + i));
+	if ((k >= 0) && (op != OP_LEA)) {
+		set_add (set, k);
+	}
+	return 1;
+}
+
+/* Frame slots live at the end of a block */
+int slot_at_end(int *set, int b) {
+	int k = 0;
+	int w = 0;
+	int n = 0;
+	set_clear (set);
+	while (k >= 0) {
+		if (k == 0) {
+			n = *((int*) blk_next + b);
+		} else if (k == 1) {
+			n = *((int*) blk_jump + b);
+		} else {
+			n = blk_case (b, k - 2);
+		}
+		if ((n < 0) && (k > 1)) {
+			k = 0 - 1;
+		} else {
+			w = 0;
+			while ((n >= 0) && (w < DEF_W)) {
+				*(set + w) = *(set + w) | *((int*) slot_in + (n * DEF_W) + w);
+				w = w + 1;
+			}
+			k = k + 1;
+		}
+	}
+	return 1;
+}
+
+/* Finds frame slots live at the start of every block */
+int slot_solve() {
+	int set[DEF_W];
+	int changed = 1;
+	int b = 0;
+	int i = 0;
+	int w = 0;
+	while (b < blk_cnt) {
+		set_clear ((int*) slot_in + (b * DEF_W));
+		b = b + 1;
+	}
+	while (changed) {
+		changed = 0;
+		b = blk_cnt - 1;
+		while (b >= 0) {
+			slot_at_end (set, b);
+			i = *((int*) blk_end + b) - 1;
+			while (i >= *((int*) blk_sta + b)) {
+				slot_step (set, i);
+				i = i - 1;
+			}
+			w = 0;
+			while (w < DEF_W) {
+				if (*(set + w) != *((int*) slot_in + (b * DEF_W) + w)) {
+					changed = 1;
+				}
+				w = w + 1;
+			}
+			set_copy ((int*) slot_in + (b * DEF_W), set);
+			b = b - 1;
+		}
+	}
+	return 1;
+}
+
+/* Marks slot k live at the same time as those of a set */
+int slot_conflict(int k, int *set, int m) {
+	int j = 0;
+	while (j < m) {
+		if ((j != k) && set_test (set, j)) {
+			set_add ((int*) slot_conf + (k * DEF_W), j);
+			set_add ((int*) slot_conf + (j * DEF_W), k);
+		}
+		j = j + 1;
+	}
+	return 1;
+}
+
+/* Offset of the frame slot a slot moves to */
+int slot_moved(int k) {
+	return (0 - 24) - (*((int*) slot_map + k) * type_sizeof (TYPE_INT));
+}
+
+/**
+ * Lets locals that are never live at the same time share a frame slot.
+ * A slot is live from a store to the last read of it, every store
+ * conflicts with the slots live right after it. Slots are colored
+ * greedily and the frame shrinks to the number of colors.
+ *
+ * @returns 1 if code was changed
+ */
+int opt_slots() {
+	int set[DEF_W];
+	int used[DEF_W];
+	int frame = 0;
+	int m = 0;
+	int c = 0;
+	int b = 0;
+	int i = 0;
+	int k = 0;
+	int op = 0;
+	while ((frame < ins_cnt) && (ins_get_op (frame) != OP_LABEL)) {
+		frame = frame + 1;
+	}
+	if ((frame == ins_cnt) || frame_escapes () || !cfg_build ()) {
+		return 0;
+	}
+	frame = ins_next (ins_prologue_end (frame));
+	while ((frame < ins_cnt) && (ins_get_op (frame) == OP_LABEL)) {
+		frame = ins_next (frame);
+	}
+	if (!ins_moves_sp (frame, OP_SUB) || !slot_check (frame)) {
+		return 0;
+	}
+	m = *((int*) ins_an + frame) / type_sizeof (TYPE_INT);
+	slot_solve ();
+	set_clear (set);
+	while (k < m) {
+		set_clear ((int*) slot_conf + (k * DEF_W));
+		set_add (set, k);
+		k = k + 1;
+	}
+	/* Slots read before any store keep to themselves */
+	k = 0;
+	while (k < m) {
+		if (set_test ((int*) slot_in, k)) {
+			slot_conflict (k, set, m);
+		}
+		k = k + 1;
+	}
+	set_clear (used);
+	while (b < blk_cnt) {
+		slot_at_end (set, b);
+		i = *((int*) blk_end + b) - 1;
+		while (i >= *((int*) blk_sta + b)) {
+			op = ins_get_op (i);
+			k = slot_of (*((char*) ins_bk + i), *((char*) ins_br + i),
+					*((int*) ins_bn + i), *((char**) ins_bs + i));
+			if ((k >= 0) && ins_is_code (i)) {
+				set_add (used, k);
+				if ((op != OP_CMP) && (op != OP_TEST)) {
+					slot_conflict (k, set, m);
+				}
+			}
+			k = slot_of (*((char*) ins_ak + i), *((char*) ins_ar + i),
+					*((int*) ins_an + i), *((char**) ins_as + i));
+			if ((k >= 0) && ins_is_code (i)) {
+				set_add (used, k);
+			}
+			slot_step (set, i);
+			i = i - 1;
+		}
+		b = b + 1;
+	}
+	/* Each slot takes the lowest one none of its conflicts took */
+	k = 0;
+	while (k < m) {
+		if (set_test (used, k)) {
+			set_clear (set);
+			i = 0;
+			while (i < k) {
+				if (set_test (used, i)
+						&& set_test ((int*) slot_conf + (k * DEF_W), i)) {
+					set_add (set, *((int*) slot_map + i));
+				}
+				i = i + 1;
+			}
+			i = 0;
+			while (set_test (set, i)) {
+				i = i + 1;
+			}
+			*((int*) slot_map + k) = i;
+			if (i >= c) {
+				c = i + 1;
+			}
+		}
+		k = k + 1;
+	}
+	if (c == m) {
+		return 0;
+	}
+	i = 0;
+	while (i < ins_cnt) {
+		k = slot_of (*((char*) ins_ak + i), *((char*) ins_ar + i),
+				*((int*) ins_an + i), *((char**) ins_as + i));
+		if ((k >= 0) && ins_is_code (i)) {
+			*((int*) ins_an + i) = slot_moved (k);
+		}
+		k = slot_of (*((char*) ins_bk + i), *((char*) ins_br + i),
+				*((int*) ins_bn + i), *((char**) ins_bs + i));
+		if ((k >= 0) && ins_is_code (i)) {
+			*((int*) ins_bn + i) = slot_moved (k);
+		}
+		i = i + 1;
+	}
+	/* Calls stay aligned with an even number of slots */
+	if (abi_sysv) {
+		c = c + (c % 2);
+	}
+	if (c > 0) {
+		*((int*) ins_an + frame) = c * type_sizeof (TYPE_INT);
+	} else {
+		ins_set_op (frame, OP_NOP);
+	}
+	return 1;
+}
+
+/* Renames a label of the function for its copy, other names stay */
+char *leaf_label(char *s, char *fn) {
+	if (compare_str (s, fn) || (ins_of_label (s) < 0)) {
+		return s;
+	}
+	return ins_name ("", s, "_leaf");
+}
+
+/**
+ * Writes out a function, then turns its buffered code into a copy
+ * without a frame if it is a leaf. The copy takes arguments the usual
+ * way but no base pointer, callers further on skip setting one up.
+ * Labels of the copy get a suffix to keep them apart.
+ *
+ * @param[in] name function name
+ * @returns 1 if the copy is left in the buffer
+ */
+int leaf_copy(char *name) {
+	int i = 0;
+	int op = 0;
+	while (i < ins_cnt) {
+		ins_write (i);
+		i = i + 1;
+	}
+	cg_close ();
+	i = 0;
+	if (!frame_elide (0)) {
+		ins_reset ();
+		return 0;
+	}
+	/* References go first, while labels still have their names */
+	while (i < ins_cnt) {
+		op = ins_get_op (i);
+		if (op != OP_LABEL) {
+			*((char**) ins_as + i) = leaf_label (*((char**) ins_as + i), name);
+			*((char**) ins_bs + i) = leaf_label (*((char**) ins_bs + i), name);
+		}
+		i = i + 1;
+	}
+	i = 0;
+	while (i < ins_cnt) {
+		if (ins_get_op (i) != OP_LABEL) {
+			/* Nothing to rename */
+		} else if (compare_str (*((char**) ins_as + i), name)) {
+			*((char**) ins_as + i) = ins_name ("__", name, "_leaf");
+		} else {
+			*((char**) ins_as + i) = ins_name ("", *((char**) ins_as + i), "_leaf");
+		}
+		i = i + 1;
+	}
+	store_var (leaves, TYPE_INT, name);
+	cg_add (ins_name ("__", name, "_leaf"), out_p);
+	return 1;
+}
+
+/* Optimizes the function through its control-flow graph */
+int optimize() {
+	int changed = 1;
+	int reach = 0;
+	/* Calls of the function itself become loops the passes can see */
+	opt_tails (1);
+	while (changed) {
+		if (!cfg_build ()) {
+			return 0;
+		}
+		if (opt_unreachable () && !cfg_build ()) {
+			return 0;
+		}
+		live_solve ();
+		changed = opt_dead_regs ();
+		reach = reach_defs ();
+		if (reach) {
+			reach_solve ();
+			changed = opt_const_slots () || changed;
+		}
+		live_solve ();
+		changed = opt_copies () || changed;
+		changed = opt_disp () || changed;
+		if (!changed) {
+			/* Loop passes move code, nothing else may run after them */
+			changed = opt_licm ()
+				|| (reach && (opt_ivs () || opt_promote ()));
+		}
+		if (!changed) {
+			/* Values are reused once loops are done with */
+			live_solve ();
+			changed = opt_values ();
+		}
+	}
+	/* Locals settle in their slots before loops are vectorized */
+	opt_slots ();
+	/* Other passes do not look into vector instructions */
+	opt_vectorize ();
+	/* Jumps to other functions leave the graph, so they come last */
+	opt_tails (0);
+	if (abi_sysv) {
+		ins_save_regs ();
+	}
+	return 1;
+}
+
+/* Optimizes buffered instructions */
+int ins_optimize() {
+	peephole ();
+	if (opt_level && optimize ()) {
+		peephole ();
+	}
+	if (opt_level && ins_rotate ()) {
+		peephole ();
+	}
+	if ((prof_mode == PROF_USE) && ins_split_cold ()) {
+		peephole ();
+	}
+	return 1;
+}
+
+/* Writes out buffered instructions */
+int ins_flush() {
+	int i = 0;
+	while (i < ins_cnt) {
+		ins_write (i);
+		i = i + 1;
+	}
+	return ins_reset ();
+}
+
+/******************************************************************************
+* Instruction emitters                                                        *
+******************************************************************************/
+
+/* op %a, %b */
+int emit_rr(int op, int a, int b) {
+	ins_new (op);
+	ins_src (K_REG, a, 0, NULL);
+	ins_dst (K_REG, b, 0, NULL);
+	return 1;
+}
+
+/* op %a */
+int emit_r(int op, int a) {
+	ins_new (op);
+	ins_src (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* op $n, %a */
+int emit_nr(int op, int n, int a) {
+	ins_new (op);
+	ins_src (K_IMM, 0, n, NULL);
+	ins_dst (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* op $s, %a */
+int emit_ns(int op, char *s, int a) {
+	ins_new (op);
+	ins_src (K_IMMS, 0, 0, ins_name ("", s, ""));
+	ins_dst (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* op name(%rip), %a */
+int emit_sr(int op, char *name, int a) {
+	ins_new (op);
+	ins_src (K_MEM, REG_IP, 0, ins_name ("", name, ""));
+	ins_dst (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* op (%a), %b */
+int emit_mr(int op, int a, int b) {
+	ins_new (op);
+	ins_src (K_MEM, a, 0, NULL);
+	ins_dst (K_REG, b, 0, NULL);
+	return 1;
+}
+
+/* op off(%rbp), %a */
+int emit_fr(int op, int off, int a) {
+	ins_new (op);
+	ins_src (K_MEM, REG_BP, off, NULL);
+	ins_dst (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* leaq (%a,%a,scale), %b */
+int emit_lea_scale(int a, int scale, int b) {
+	ins_new (OP_LEA);
+	ins_src (K_IDX, a, scale, NULL);
+	ins_dst (K_REG, b, 0, NULL);
+	return 1;
+}
+
+/* op $n */
+int emit_n(int op, int n) {
+	ins_new (op);
+	ins_src (K_IMM, 0, n, NULL);
+	return 1;
+}
+
+/* op name */
+int emit_s(int op, char *name) {
+	ins_new (op);
+	ins_src (K_SYM, 0, 0, ins_name ("", name, ""));
+	return 1;
+}
+
+/* Sets memory destination operand of the last instruction, which is
+ * composed of optional displacement or name and a base register */
+int ins_dst_mem(char *disp, int off, int base) {
+	if (disp) {
+		disp = ins_name ("", disp, "");
+	}
+	return ins_dst (K_MEM, base, off, disp);
+}
+
+/* Stores a register of given type to memory operand */
+int emit_store(int a, int type, char *disp, int off, int base) {
+	if (type == TYPE_CHR) {
+		ins_new (OP_MOVB);
+	} else {
+		ins_new (OP_MOV);
+	}
+	ins_src (K_REG, a, 0, NULL);
+	return ins_dst_mem (disp, off, base);
+}
+
+/* Stores an immediate of given type to memory operand */
+int emit_store_n(int n, int type, char *disp, int off, int base) {
+	if (type == TYPE_CHR) {
+		ins_new (OP_MOVB);
+	} else {
+		ins_new (OP_MOV);
+	}
+	ins_src (K_IMM, 0, n, NULL);
+	return ins_dst_mem (disp, off, base);
+}
+
+/* movdqu off(%base), %vec, or the other way round if store is set */
+int emit_vmov(int store, int vec, int off, int base) {
+	ins_new (OP_VMOV);
+	if (store) {
+		ins_src (K_VEC, vec, 0, NULL);
+		return ins_dst (K_MEM, base, off, NULL);
+	}
+	ins_src (K_MEM, base, off, NULL);
+	return ins_dst (K_VEC, vec, 0, NULL);
+}
+
+/* set<cc> %a8, then zero-extend it to %a */
+int emit_setcc(int cc, int a) {
+	ins_new (OP_SETCC);
+	*((char*) ins_cc + ins_cnt - 1) = (char) cc;
+	ins_dst (K_REG, a, 0, NULL);
+	return 1;
+}
+
+/* j<cc> name */
+int emit_jcc(int cc, char *name) {
+	emit_s (OP_JCC, name);
+	*((char*) ins_cc + ins_cnt - 1) = (char) cc;
+	return 1;
+}
+
+/* .long name - table, where the table is named after its fallback */
+int emit_case(char *name, char *table) {
+	ins_new (OP_CASE);
+	ins_src (K_SYM, 0, 0, name);
+	ins_dst (K_SYM, 0, 0, table);
+	return 1;
+}
+
+/* Jumps through the entries right before, index in %a, %b is scratch */
+int emit_jtab(char *table, int a, int b) {
+	ins_new (OP_JTAB);
+	ins_src (K_REG, a, 0, table);
+	ins_dst (K_REG, b, 0, NULL);
+	return 1;
+}
+
+int emit_label_x(char *prefix, char *name, char *suffix) {
+	ins_new (OP_LABEL);
+	ins_src (K_SYM, 0, 0, ins_name (prefix, name, suffix));
+	return 1;
+}
+
+/* Instruction given as a whole line of text */
+int emit_text(char *s) {
+	ins_new (OP_TEXT);
+	ins_src (K_SYM, 0, 0, s);
+	return 1;
+}
+
+int emit_mov(int src, int dst) {
+	if (src != dst) {
+		emit_rr (OP_MOV, src, dst);
+	}
+	return 1;
+}
+
+int emit_push(int r) {
+	return emit_r (OP_PUSH, r);
+}
+
+int emit_push_n(int n) {
+	return emit_n (OP_PUSH, n);
+}
+
+int emit_pop(int r) {
+	return emit_r (OP_POP, r);
+}
+
+/******************************************************************************
+* Operand stack                                                               *
+******************************************************************************/
+
+int reg_pool(int n) {
+	/* rax, rbx, rcx, rdx, rsi, then r8 to r11,
+	 * rdi stands in for rbx when that holds the allocation pointer */
+	if ((n == REG_BX) && (alloc_reg == REG_BX)) {
+		return REG_DI;
+	}
+	if (n < 5) {
+		return n;
+	}
+	return n + 3;
+}
+
+int arg_reg(int n) {
+	/* rdi, rsi, rdx, rcx, then r8 and r9 */
+	if (n < 4) {
+		return REG_DI - n;
+	}
+	return n + 4;
+}
+
+/**
+ * Counts slots a function saves its register arguments to.
+ * Callers may pass more arguments than the function declares, which
+ * it can reach through the address of its own ones. These are saved
+ * too, in pairs so that the stack stays aligned as it is.
+ *
+ * @param[in] argc number of arguments declared
+ * @returns number of slots
+ */
+int arg_slots(int argc) {
+	if (arg_addr && (argc < ARG_REGS)) {
+		return ARG_REGS + (argc % 2);
+	}
+	return argc;
+}
+
+int reg_free(int r) {
+	*((char*) reg_busy + r) = (char) 0;
+	return 1;
+}
+
+int vs_reset() {
+	clear_memory (reg_busy, REG_CNT);
+	vs_cnt = 0;
+	return 1;
+}
+
+/* Number of entries spilled to machine stack */
+int vs_mem_cnt() {
+	int n = 0;
+	while ((n < vs_cnt) && (*((char*) vs_kind + n) == VS_MEM)) {
+		n = n + 1;
+	}
+	return n;
+}
+
+int vs_push(int r) {
+	if (vs_cnt == VS_SZ) {
+		write_err ("expression is too complex");
+		return 0;
+	}
+	*((char*) vs_kind + vs_cnt) = (char) VS_REG;
+	*((char*) vs_reg + vs_cnt) = (char) r;
+	vs_cnt = vs_cnt + 1;
+	return 1;
+}
+
+int vs_push_const(int v) {
+	vs_settle ();
+	if (vs_cnt == VS_SZ) {
+		write_err ("expression is too complex");
+		return 0;
+	}
+	*((char*) vs_kind + vs_cnt) = (char) VS_CONST;
+	*((int*) vs_val + vs_cnt) = v;
+	vs_cnt = vs_cnt + 1;
+	return 1;
+}
+
+/* Tests if an entry at given depth from the top is a constant */
+int vs_is_const(int depth) {
+	if (vs_cnt > depth) {
+		return (*((char*) vs_kind + vs_cnt - depth - 1) == VS_CONST);
+	}
+	return 0;
+}
+
+int vs_const_val(int depth) {
+	return *((int*) vs_val + vs_cnt - depth - 1);
+}
+
+/* Tests if an entry at given depth is a constant of given value */
+int vs_is_val(int depth, int v) {
+	if (vs_is_const (depth)) {
+		return (vs_const_val (depth) == v);
+	}
+	return 0;
+}
+
+int vs_pop_const() {
+	vs_cnt = vs_cnt - 1;
+	return *((int*) vs_val + vs_cnt);
+}
+
+/**
+ * Pushes a comparison result, which is only kept in CPU flags.
+ * Such an entry may only stay on top: it gets materialized before
+ * anything else is allocated or pushed, as that might clobber flags.
+ *
+ * @param[in] cc condition code that holds for a true result
+ * @returns 1
+ */
+int vs_push_flags(int cc) {
+	vs_settle ();
+	*((char*) vs_kind + vs_cnt) = (char) VS_FLAGS;
+	*((int*) vs_val + vs_cnt) = cc;
+	vs_cnt = vs_cnt + 1;
+	return 1;
+}
+
+int vs_is_flags() {
+	if (vs_cnt > 0) {
+		return (*((char*) vs_kind + vs_cnt - 1) == VS_FLAGS);
+	}
+	return 0;
+}
+
+/* Turns a flags entry on top into a register one */
+int vs_settle() {
+	int r = 0;
+	if (vs_is_flags ()) {
+		r = vs_pop ();
+		vs_push (r);
+	}
+	return 1;
+}
+
+/**
+ * Spills the bottom-most register or constant entry to machine stack.
+ * Spilled entries thus always stay below the cached ones.
+ *
+ * @returns 1 if an entry was spilled, 0 if none left
+ */
+int vs_spill() {
+	int n = 0;
+	while (n < vs_cnt) {
+		if (*((char*) vs_kind + n) == VS_REG) {
+			emit_push (*((char*) vs_reg + n));
+			reg_free (*((char*) vs_reg + n));
+			*((char*) vs_kind + n) = (char) VS_MEM;
+			return 1;
+		}
+		if (*((char*) vs_kind + n) == VS_CONST) {
+			emit_push_n (*((int*) vs_val + n));
+			*((char*) vs_kind + n) = (char) VS_MEM;
+			return 1;
+		}
+		n = n + 1;
+	}
+	return 0;
+}
+
+int vs_flush() {
+	vs_settle ();
+	while (vs_spill ());
+	return 1;
+}
+
+int reg_alloc() {
+	int n = 0;
+	int r = 0;
+	vs_settle ();
+	while (1) {
+		n = 0;
+		while (n < REG_POOL) {
+			r = reg_pool (n);
+			if (!*((char*) reg_busy + r) && !(reg_rsv & bitmask (r))) {
+				*((char*) reg_busy + r) = (char) 1;
+				return r;
+			}
+			n = n + 1;
+		}
+		if (!vs_spill ()) {
+			write_err ("out of registers");
+			return REG_AX;
+		}
+	}
+	return REG_AX;
+}
+
+/**
+ * Moves an operand stack entry out of the register,
+ * so that it can be used for a dedicated purpose.
+ * The register is left busy for the caller; registers in reg_rsv
+ * are not picked to hold the entry either.
+ *
+ * @param[in] r register to be vacated
+ * @returns 1
+ */
+int reg_evict(int r) {
+	int n = 0;
+	int new_r = 0;
+	int rsv = reg_rsv;
+	reg_rsv = reg_rsv | bitmask (r);
+	while (n < vs_cnt) {
+		if ((*((char*) vs_kind + n) == VS_REG)
+				&& (*((char*) vs_reg + n) == r)) {
+			new_r = reg_alloc ();
+			if ((*((char*) vs_kind + n) == VS_REG)
+					&& (*((char*) vs_reg + n) == r)) {
+				emit_mov (r, new_r);
+				*((char*) vs_reg + n) = (char) new_r;
+			} else {
+				/* allocation has spilled it already */
+				reg_free (new_r);
+			}
+			n = vs_cnt;
+		}
+		n = n + 1;
+	}
+	reg_rsv = rsv;
+	*((char*) reg_busy + r) = (char) 1;
+	return 1;
+}
+
+/* Vacates rax and rdx for a multiplication or division */
+int reg_claim_ax_dx() {
+	reg_rsv = bitmask (REG_AX) | bitmask (REG_DX);
+	reg_evict (REG_AX);
+	reg_evict (REG_DX);
+	reg_rsv = 0;
+	return 1;
+}
+
+/**
+ * Takes an entry off the operand stack
+ *
+ * @returns register holding the value
+ */
+int vs_pop() {
+	int r = 0;
+	int v = 0;
+	if (vs_cnt > 0) {
+		vs_cnt = vs_cnt - 1;
+		if (*((char*) vs_kind + vs_cnt) == VS_REG) {
+			return *((char*) vs_reg + vs_cnt);
+		}
+		if (*((char*) vs_kind + vs_cnt) == VS_CONST) {
+			/* Materialize the constant */
+			v = *((int*) vs_val + vs_cnt);
+			r = reg_alloc ();
+			emit_nr (OP_MOV, v, r);
+			return r;
+		}
+		if (*((char*) vs_kind + vs_cnt) == VS_FLAGS) {
+			v = *((int*) vs_val + vs_cnt);
+			r = reg_alloc ();
+			emit_setcc (v, r);
+			return r;
+		}
+	}
+	r = reg_alloc ();
+	emit_pop (r);
+	return r;
+}
+
+/**
+ * Takes an entry off the operand stack into a given register
+ *
+ * @param[in] r destination register
+ * @returns r
+ */
+int vs_pop_to(int r) {
+	int a = 0;
+	if (vs_is_const (0)) {
+		a = vs_pop_const ();
+		reg_evict (r);
+		emit_nr (OP_MOV, a, r);
+		return r;
+	}
+	if (vs_is_flags ()) {
+		a = vs_pop_const ();
+		reg_evict (r);
+		emit_setcc (a, r);
+		return r;
+	}
+	a = vs_pop ();
+	if (a != r) {
+		reg_evict (r);
+		emit_mov (a, r);
+		reg_free (a);
+	}
+	return r;
+}
+
+/******************************************************************************
+* Code generation functions                                                   *
+******************************************************************************/
+
+/**
+ * Computes a binary operation on two constants
+ *
+ * @param[in] op operator character, `l` and `g` stand for <= and >=
+ * @param[in] a left operand
+ * @param[in] b right operand
+ * @returns result
+ */
+int fold_binop(char op, int a, int b) {
+	if (op == '+') return a + b;
+	if (op == '-') return a - b;
+	if (op == '*') return a * b;
+	if (op == '/') return a / b;
+	if (op == '%') return a % b;
+	if (op == '&') return a & b;
+	if (op == '|') return a | b;
+	if (op == '<') return (a < b);
+	if (op == '>') return (a > b);
+	if (op == 'l') return (a <= b);
+	if (op == 'g') return (a >= b);
+	if (op == '=') return (a == b);
+	return (a != b);
+}
+
+int fold_fits(int v, int lim) {
+	return (v < lim) && ((0 - v) < lim);
+}
+
+/**
+ * Replaces two constants on top of operand stack with
+ * the result of operation, if it is safe to do so
+ *
+ * @param[in] op operator character as in fold_binop
+ * @param[in] lim operands magnitude limit
+ * @returns 1 if folded, 0 if code has to be generated
+ */
+int _gen_cmd_fold(char op, int lim) {
+	int b = 0;
+	if (!vs_is_const (0) || !vs_is_const (1)) {
+		return 0;
+	}
+	b = vs_const_val (0);
+	if (!fold_fits (b, lim) || !fold_fits (vs_const_val (1), lim)) {
+		return 0;
+	}
+	if ((op == '/') || (op == '%')) {
+		/* Division is unsigned on target */
+		if ((b < 1) || (vs_const_val (1) < 0)) {
+			return 0;
+		}
+	}
+	vs_pop_const ();
+	return vs_push_const (fold_binop (op, vs_pop_const (), b));
+}
+
+int _gen_cmd_binop(int op, int comm) {
+	int b = 0;
+	int a = 0;
+	if (vs_is_const (0)) {
+		b = vs_pop_const ();
+		a = vs_pop ();
+		emit_nr (op, b, a);
+		vs_push (a);
+		return 1;
+	}
+	b = vs_pop ();
+	if (comm && vs_is_const (0)) {
+		emit_nr (op, vs_pop_const (), b);
+		vs_push (b);
+		return 1;
+	}
+	a = vs_pop ();
+	emit_rr (op, b, a);
+	reg_free (b);
+	vs_push (a);
+	return 1;
+}
+
+int swap_chr(char *a, char *b) {
+	char t = *a;
+	*a = *b;
+	*b = t;
+	return 1;
+}
+
+/**
+ * Copies or fills memory a chunk at a time, the chunk being a vector
+ * register, a quadword or a byte, whichever is the largest that fits.
+ * The last chunk is moved back to end where the size does.
+ *
+ * @param[in] fill 1 to fill with the byte in rcx, 0 to copy from (%rcx)
+ * @param[in] n size, the destination being in rax
+ * @returns 1
+ */
+int gen_mem_unrolled(int fill, int n) {
+	int w = 16 + (16 * vec_avx);
+	int c = 1;
+	int off = 0;
+	int t = reg_alloc ();
+	if (n >= w) {
+		c = w;
+	} else if ((n >= 8) && !fill) {
+		c = 8;
+	}
+	if (fill && (c == w)) {
+		ins_new (OP_VSPLAT);
+		*((char*) ins_cc + ins_cnt - 1) = (char) 1;
+		ins_src (K_REG, REG_CX, 0, NULL);
+		ins_dst (K_VEC, 1, 0, NULL);
+	}
+	while (off < n) {
+		if ((off + c) > n) {
+			off = n - c;
+		}
+		if (fill && (c == w)) {
+			emit_vmov (1, 1, off, REG_AX);
+		} else if (fill) {
+			emit_store (REG_CX, TYPE_CHR, NULL, off, REG_AX);
+		} else if (c == w) {
+			emit_vmov (0, 0, off, REG_CX);
+			emit_vmov (1, 0, off, REG_AX);
+		} else if (c == 8) {
+			ins_new (OP_MOV);
+			ins_src (K_MEM, REG_CX, off, NULL);
+			ins_dst (K_REG, t, 0, NULL);
+			emit_store (t, TYPE_INT, NULL, off, REG_AX);
+		} else {
+			ins_new (OP_MOVZB);
+			ins_src (K_MEM, REG_CX, off, NULL);
+			ins_dst (K_REG, t, 0, NULL);
+			emit_store (t, TYPE_CHR, NULL, off, REG_AX);
+		}
+		off = off + c;
+	}
+	if (vec_avx && (c == w)) {
+		emit_text ("  vzeroupper");
+	}
+	reg_free (t);
+	return 1;
+}
+
+/**
+ * Copies or fills memory, taking the size, the source or the byte to
+ * fill with, then the destination off the operand stack. Sizes known
+ * to be small are done with moves, others with rep movsb or rep stosb.
+ * The destination is left in rax for the result.
+ *
+ * @param[in] fill 1 for memset, 0 for memcpy
+ * @returns 1
+ */
+int gen_cmd_mem(int fill) {
+	int n = 0 - 1;
+	if (vs_is_const (0)) {
+		n = vs_const_val (0);
+	}
+	if ((n >= 0) && (n <= MEM_UNROLL)
+			&& (!fill || (n <= 8) || (n >= (16 + (16 * vec_avx))))) {
+		vs_pop_const ();
+		vs_pop_to (REG_CX);
+		vs_pop_to (REG_AX);
+		gen_mem_unrolled (fill, n);
+		reg_free (REG_CX);
+		reg_free (REG_AX);
+		return 1;
+	}
+	vs_pop_to (REG_CX);
+	if (fill) {
+		vs_pop_to (REG_AX);
+	} else {
+		vs_pop_to (REG_SI);
+	}
+	vs_pop_to (REG_DX);
+	if (alloc_reg == REG_DI) {
+		emit_push (REG_DI);
+	}
+	emit_mov (REG_DX, REG_DI);
+	ins_new (OP_REP);
+	*((char*) ins_cc + ins_cnt - 1) = (char) fill;
+	if (alloc_reg == REG_DI) {
+		emit_pop (REG_DI);
+	}
+	emit_mov (REG_DX, REG_AX);
+	reg_free (REG_CX);
+	reg_free (REG_AX);
+	reg_free (REG_SI);
+	reg_free (REG_DX);
+	return 1;
+}
+
+int gen_cmd_swap() {
+	int n = vs_cnt - 2;
+	int t = 0;
+	int b = 0;
+	int a = 0;
+	if ((vs_cnt > 1) && (*((char*) vs_kind + n) != VS_MEM)
+			&& !vs_is_flags ()) {
+		/* Nothing on machine stack, swap at compile time */
+		swap_chr (vs_kind + n, vs_kind + n + 1);
+		swap_chr (vs_reg + n, vs_reg + n + 1);
+		t = *((int*) vs_val + n);
+		*((int*) vs_val + n) = *((int*) vs_val + n + 1);
+		*((int*) vs_val + n + 1) = t;
+		return 1;
+	}
+	b = vs_pop ();
+	a = vs_pop ();
+	vs_push (b);
+	vs_push (a);
+	return 1;
+}
+
+int gen_cmd_pushns(char *value) {
+	int r = 0;
+	int len = 0;
+	while (*(value + len)) {
+		len = len + 1;
+	}
+	if (len < 10) {
+		return vs_push_const (strtonum (value));
+	}
+	r = reg_alloc ();
+	emit_ns (OP_MOV, value, r);
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_pushni(int value) {
+	return vs_push_const (value);
+}
+
+int gen_cmd_pushl(char *name) {
+	int r = reg_alloc ();
+	emit_sr (OP_LEA, name, r);
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_pushi(int type) {
+	int a = vs_pop ();
+	if (type == TYPE_CHR) {
+		emit_mr (OP_MOVZB, a, a);
+	} else {
+		emit_mr (OP_MOV, a, a);
+	}
+	vs_push (a);
+	return 1;
+}
+
+int gen_cmd_popi(int type) {
+	int v = 0;
+	int a = 0;
+	if (vs_is_const (0)) {
+		v = vs_pop_const ();
+		a = vs_pop ();
+		emit_store_n (v, type, NULL, 0, a);
+		reg_free (a);
+		return 1;
+	}
+	v = vs_pop ();
+	a = vs_pop ();
+	emit_store (v, type, NULL, 0, a);
+	reg_free (v);
+	reg_free (a);
+	return 1;
+}
+
+int gen_cmd_inv() {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return vs_push_const (~vs_pop_const ());
+	}
+	a = vs_pop ();
+	emit_r (OP_NOT, a);
+	vs_push (a);
+	return 1;
+}
+
+int gen_cmd_add() {
+	if (_gen_cmd_fold ('+', FOLD_LIM)) {
+		return 1;
+	}
+	if (vs_is_val (0, 0)) {
+		return gen_cmd_drop ();
+	}
+	return _gen_cmd_binop (OP_ADD, 1);
+}
+
+int gen_cmd_sub() {
+	if (_gen_cmd_fold ('-', FOLD_LIM)) {
+		return 1;
+	}
+	if (vs_is_val (0, 0)) {
+		return gen_cmd_drop ();
+	}
+	return _gen_cmd_binop (OP_SUB, 0);
+}
+
+int gen_cmd_call(char *name) {
+	int pad = 0;
+	int type = 0;
+	int n = 0;
+	/* Everything cached is clobbered by the callee */
+	vs_flush ();
+	if (abi_sysv) {
+		/* Arguments are in registers already. The stack is aligned
+		 * to 16 bytes at the call: frames of functions with an even
+		 * number of arguments start aligned, locals take an even
+		 * number of slots, then every spilled entry takes one. */
+		pad = (count_vars (arguments) + vs_mem_cnt () + 1) % 2;
+		if (pad) {
+			emit_nr (OP_SUB, type_sizeof (TYPE_INT), REG_SP);
+		}
+		/* No vector registers are passed to variadic functions */
+		emit_rr (OP_XOR, REG_AX, REG_AX);
+		emit_s (OP_CALL, name);
+		if (pad) {
+			emit_nr (OP_ADD, type_sizeof (TYPE_INT), REG_SP);
+		}
+		return 1;
+	}
+	if (find_var (leaves, name, &type, &n)) {
+		/* Copies of leaf functions take no base pointer */
+		emit_s (OP_CALL, ins_name ("__", name, "_leaf"));
+		return 1;
+	}
+	/* Save old base to stack, set a new base */
+	emit_push (REG_BP);
+	emit_rr (OP_MOV, REG_SP, REG_BP);
+	emit_s (OP_CALL, name);
+	/* Restore old base from stack */
+	emit_pop (REG_BP);
+	return 1;
+}
+
+/**
+ * Passes arguments of a call past those in registers on the stack.
+ * All of them are spilled first, the last one on top, then these get
+ * copied above in reverse, so that the first of them is on top at the
+ * call, and the rest are loaded to registers from their slots. The
+ * spilled arguments, the copies and the padding that keeps the call
+ * aligned stay on the operand stack to be dropped after the call.
+ *
+ * @param[in] argc number of arguments, more than ARG_REGS
+ * @returns number of operand stack entries to drop after the call
+ */
+int gen_cmd_args_stack(int argc) {
+	int extra = argc - ARG_REGS;
+	int w = type_sizeof (TYPE_INT);
+	int pad = 0;
+	int n = 0;
+	vs_flush ();
+	pad = (count_vars (arguments) + vs_mem_cnt () + extra + 1) % 2;
+	if (pad) {
+		emit_nr (OP_SUB, w, REG_SP);
+	}
+	/* Each copy is as far from the top as the previous one */
+	n = 0;
+	while (n < extra) {
+		ins_new (OP_PUSH);
+		ins_src (K_MEM, REG_SP, (pad + (2 * n)) * w, NULL);
+		n = n + 1;
+	}
+	n = 0;
+	while (n < ARG_REGS) {
+		reg_evict (arg_reg (n));
+		ins_new (OP_MOV);
+		ins_src (K_MEM, REG_SP, (pad + extra + (argc - 1 - n)) * w, NULL);
+		ins_dst (K_REG, arg_reg (n), 0, NULL);
+		n = n + 1;
+	}
+	/* Copies and padding count as spilled entries */
+	n = 0;
+	while (n < (extra + pad)) {
+		*((char*) vs_kind + vs_cnt) = (char) VS_MEM;
+		vs_cnt = vs_cnt + 1;
+		n = n + 1;
+	}
+	return argc + extra + pad;
+}
+
+int gen_cmd_push_ret() {
+	/* Return value arrives in rax, nothing else is cached after call */
+	*((char*) reg_busy + REG_AX) = (char) 1;
+	vs_push (REG_AX);
+	return 1;
+}
+
+int gen_cmd_pop_ret() {
+	reg_free (vs_pop_to (REG_AX));
+	return 1;
+}
+
+int gen_cmd_push_local(int off, int type) {
+	int r = reg_alloc ();
+	if (type == TYPE_CHR) {
+		emit_fr (OP_MOVZB, off, r);
+	} else {
+		emit_fr (OP_MOV, off, r);
+	}
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_pop_local(int off, int type) {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return emit_store_n (vs_pop_const (), type, NULL, off, REG_BP);
+	}
+	a = vs_pop ();
+	emit_store (a, type, NULL, off, REG_BP);
+	reg_free (a);
+	return 1;
+}
+
+/* Pushes n-th argument of the function being inlined, or its address.
+ * Arguments lie on stack below entries spilled after them. */
+int gen_cmd_push_arg(int op, int n) {
+	int r = reg_alloc ();
+	if (inl_order) {
+		n = inl_order + 1 - n;
+	}
+	ins_new (op);
+	ins_src (K_MEM, REG_SP,
+			(vs_mem_cnt () - inl_base + n - 1) * type_sizeof (TYPE_INT), NULL);
+	ins_dst (K_REG, r, 0, NULL);
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_push_addr(int off) {
+	int r = reg_alloc ();
+	emit_fr (OP_LEA, off, r);
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_push_pool() {
+	int r = reg_alloc ();
+	emit_mov (alloc_reg, r);
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_alloc_pool() {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return emit_nr (OP_ADD, vs_pop_const (), alloc_reg);
+	}
+	a = vs_pop ();
+	emit_rr (OP_ADD, a, alloc_reg);
+	reg_free (a);
+	return 1;
+}
+
+int gen_cmd_jump(char *name) {
+	vs_flush ();
+	return emit_s (OP_JMP, name);
+}
+
+int gen_cmd_jump_x(char *prefix, char *name, char *suffix) {
+	vs_flush ();
+	ins_new (OP_JMP);
+	return ins_src (K_SYM, 0, 0, ins_name (prefix, name, suffix));
+}
+
+int gen_cmd_nzjump(char *name) {
+	int a = 0;
+	if (vs_is_const (0)) {
+		if (vs_pop_const ()) {
+			return gen_cmd_jump (name);
+		}
+		return vs_flush ();
+	}
+	if (vs_is_flags ()) {
+		/* Spilling the rest does not touch flags */
+		a = vs_pop_const ();
+		vs_flush ();
+		return emit_jcc (a, name);
+	}
+	a = vs_pop ();
+	vs_flush ();
+	emit_rr (OP_TEST, a, a);
+	emit_jcc (CC_NE, name);
+	reg_free (a);
+	return 1;
+}
+
+int gen_cmd_push_static(char *name, int type) {
+	int r = reg_alloc ();
+	if (type == TYPE_CHR) {
+		emit_sr (OP_MOVZB, name, r);
+	} else if (type & TYPE_ARR) {
+		emit_sr (OP_LEA, name, r);
+	} else {
+		emit_sr (OP_MOV, name, r);
+	}
+	vs_push (r);
+	return 1;
+}
+
+int gen_cmd_pop_static(char *name, int type) {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return emit_store_n (vs_pop_const (), type, name, 0, REG_IP);
+	}
+	a = vs_pop ();
+	emit_store (a, type, name, 0, REG_IP);
+	reg_free (a);
+	return 1;
+}
+
+int gen_cmd_label_x(char *prefix, char *name, char *suffix) {
+	/* Operand stack has to look the same on every path to a label */
+	vs_flush ();
+	return emit_label_x (prefix, name, suffix);
+}
+
+int gen_cmd_label(char *name) {
+	gen_cmd_label_x("", name, "");
+	gen_prof ();
+	return 1;
+}
+
+/**
+ * Sends the value in rax to the matching case label of a switch, or to
+ * the fallback label if there is none. Dense ranges of cases go through
+ * a jump table, others through a binary search over their values.
+ *
+ * @param[in] lo first case
+ * @param[in] hi case after the last one, cases are sorted by value
+ * @param[in] def fallback label
+ * @returns 1
+ */
+int gen_cmd_switch(int lo, int hi, char *def) {
+	char lbl[ID_SZ];
+	int n = 0;
+	int min = 0;
+	int max = 0;
+	int mid = 0;
+	/* Long literals are compared one by one, they take a register */
+	while ((hi > lo) && *((char**) sw_big + hi - 1)) {
+		hi = hi - 1;
+		emit_ns (OP_MOV, *((char**) sw_big + hi), REG_DX);
+		emit_rr (OP_CMP, REG_DX, REG_AX);
+		emit_jcc (CC_E, *((char**) sw_lbl + hi));
+	}
+	n = hi - lo;
+	mid = lo + (n / 2);
+	if (n == 0) {
+		return gen_cmd_jump (def);
+	}
+	min = *((int*) sw_val + lo);
+	max = *((int*) sw_val + hi - 1);
+	if ((n >= SW_TABLE) && ((max - min) < (n * SW_DENSE))) {
+		/* The value becomes an index, gaps go to the fallback */
+		if (min) {
+			emit_nr (OP_SUB, min, REG_AX);
+		}
+		emit_nr (OP_CMP, 0, REG_AX);
+		emit_jcc (CC_L, def);
+		emit_nr (OP_CMP, max - min, REG_AX);
+		emit_jcc (CC_G, def);
+		while (min <= max) {
+			if (*((int*) sw_val + lo) == min) {
+				emit_case (*((char**) sw_lbl + lo), def);
+				lo = lo + 1;
+			} else {
+				emit_case (def, def);
+			}
+			min = min + 1;
+		}
+		return emit_jtab (def, REG_AX, REG_DX);
+	}
+	if (n < SW_TABLE) {
+		while (lo < hi) {
+			emit_nr (OP_CMP, *((int*) sw_val + lo), REG_AX);
+			emit_jcc (CC_E, *((char**) sw_lbl + lo));
+			lo = lo + 1;
+		}
+		return gen_cmd_jump (def);
+	}
+	new_label (lbl);
+	emit_nr (OP_CMP, *((int*) sw_val + mid), REG_AX);
+	emit_jcc (CC_E, *((char**) sw_lbl + mid));
+	emit_jcc (CC_L, lbl);
+	gen_cmd_switch (mid + 1, hi, def);
+	gen_cmd_label (lbl);
+	return gen_cmd_switch (lo, mid, def);
+}
+
+int gen_cmd_not() {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return vs_push_const (!vs_pop_const ());
+	}
+	if (vs_is_flags ()) {
+		return vs_push_flags (cc_not (vs_pop_const ()));
+	}
+	a = vs_pop ();
+	emit_rr (OP_TEST, a, a);
+	reg_free (a);
+	return vs_push_flags (CC_E);
+}
+
+/* Turns the top entry into 0 or 1 */
+int gen_cmd_bool() {
+	int a = 0;
+	if (vs_is_const (0)) {
+		return vs_push_const (!!vs_pop_const ());
+	}
+	if (vs_is_flags ()) {
+		return 1;
+	}
+	a = vs_pop ();
+	emit_rr (OP_TEST, a, a);
+	reg_free (a);
+	return vs_push_flags (CC_NE);
+}
+
+int gen_cmd_and() {
+	if (_gen_cmd_fold ('&', FOLD_LIM)) {
+		return 1;
+	}
+	return _gen_cmd_binop (OP_AND, 1);
+}
+
+int gen_cmd_or() {
+	if (_gen_cmd_fold ('|', FOLD_LIM)) {
+		return 1;
+	}
+	if (vs_is_val (0, 0)) {
+		return gen_cmd_drop ();
+	}
+	return _gen_cmd_binop (OP_OR, 1);
+}
+
+int gen_cmd_dropn(int n) {
+	/* Spilled entries only, leave RAX intact as it may hold return value */
+	if (n > 0) {
+		if (vs_cnt < n) {
+			vs_cnt = 0;
+		} else {
+			vs_cnt = vs_cnt - n;
+		}
+		emit_nr (OP_ADD, n * type_sizeof (TYPE_INT), REG_SP);
+	}
+	return 1;
+}
+
+int gen_cmd_drop() {
+	int a = 0;
+	if ((vs_cnt > 0)
+			&& (*((char*) vs_kind + vs_cnt - 1) == VS_REG)) {
+		a = vs_pop ();
+		reg_free (a);
+	} else if (vs_is_const (0) || vs_is_flags ()) {
+		vs_pop_const ();
+	} else {
+		gen_cmd_dropn (1);
+	}
+	return 1;
+}
+
+/**
+ * Compares two topmost entries, the result is left in flags
+ *
+ * @param[in] op operator character as in fold_binop
+ * @param[in] cc condition code
+ * @returns 1
+ */
+int _gen_cmd_cmp(char op, int cc) {
+	int b = 0;
+	int a = 0;
+	if (_gen_cmd_fold (op, FOLD_LIM)) {
+		return 1;
+	}
+	if (vs_is_const (0)) {
+		b = vs_pop_const ();
+		a = vs_pop ();
+		emit_nr (OP_CMP, b, a);
+	} else {
+		b = vs_pop ();
+		if (vs_is_const (0)) {
+			emit_nr (OP_CMP, vs_pop_const (), b);
+			a = b;
+			cc = cc_swap (cc);
+		} else {
+			a = vs_pop ();
+			emit_rr (OP_CMP, b, a);
+			reg_free (b);
+		}
+	}
+	reg_free (a);
+	return vs_push_flags (cc);
+}
+
+int gen_cmd_cmpeq() {
+	return _gen_cmd_cmp ('=', CC_E);
+}
+
+int gen_cmd_cmpne() {
+	return _gen_cmd_cmp ('!', CC_NE);
+}
+
+int gen_cmd_cmplt() {
+	return _gen_cmd_cmp ('<', CC_L);
+}
+
+int gen_cmd_cmple() {
+	return _gen_cmd_cmp ('l', CC_LE);
+}
+
+int gen_cmd_cmpgt() {
+	return _gen_cmd_cmp ('>', CC_G);
+}
+
+int gen_cmd_cmpge() {
+	return _gen_cmd_cmp ('g', CC_GE);
+}
+
+/* Multiplies by a constant using shifts and leaq where possible */
+int _gen_cmd_mul_n(int n) {
+	int k = log2_exact (n);
+	int a = 0;
+	if (n == 0) {
+		gen_cmd_drop ();
+		return vs_push_const (0);
+	}
+	a = vs_pop ();
+	if (k > 0) {
+		emit_nr (OP_SHL, k, a);
+	} else if ((n == 3) || (n == 5) || (n == 9)) {
+		emit_lea_scale (a, n - 1, a);
+	} else {
+		emit_nr (OP_IMUL, n, a);
+	}
+	vs_push (a);
+	return 1;
+}
+
+/**
+ * Collects binary digits of a quotient in a long division.
+ * Divisor has to be small enough for doubled remainder to fit in int.
+ *
+ * @param[in] r initial remainder, less than d
+ * @param[in] d divisor
+ * @param[in] steps number of zero bits appended to dividend
+ * @param[out] bits last 64 quotient digits, most significant first
+ * @returns remainder
+ */
+int long_div_bits(int r, int d, int steps, char *bits) {
+	int n = 0;
+	char bit = 0;
+	while (n < steps) {
+		r = r + r;
+		bit = 0;
+		if (r >= d) {
+			r = r - d;
+			bit = 1;
+		}
+		if ((n + 64) >= steps) {
+			*(bits + n + 64 - steps) = bit;
+		}
+		n = n + 1;
+	}
+	return r;
+}
+
+/* Writes a 64 bit number given in binary digits as hexadecimal string */
+int bits_to_hex(char *bits, int inc, char *dst) {
+	char *digits = "0123456789abcdef";
+	int n = 63;
+	int v = 0;
+	/* Increment with carry if requested */
+	while (inc && (n >= 0)) {
+		*(bits + n) = (char) !*(bits + n);
+		inc = !*(bits + n);
+		n = n - 1;
+	}
+	copy_memory (dst, "0x", 2);
+	n = 0;
+	while (n < 16) {
+		v = *(bits + (n * 4)) * 8;
+		v = v + (*(bits + (n * 4) + 1) * 4);
+		v = v + (*(bits + (n * 4) + 2) * 2);
+		v = v + *(bits + (n * 4) + 3);
+		*(dst + n + 2) = *(digits + v);
+		n = n + 1;
+	}
+	*(dst + 18) = (char) 0;
+	return 1;
+}
+
+/**
+ * Finds a multiplier for unsigned division by a constant, such that
+ * the quotient is the high half of the product shifted right.
+ * When the multiplier would take 65 bits, it is reduced by 2^64 and
+ * the division needs a fixup: q = (t + ((n - t) >> 1)) >> shift.
+ *
+ * @param[in] d divisor, not a power of two
+ * @param[out] dst hexadecimal multiplier
+ * @param[out] shift post shift count
+ * @returns 1 if the fixup is needed, 0 otherwise
+ */
+int div_magic(int d, char *dst, int *shift) {
+	char bits[64];
+	int l = 0;
+	int p = 1;
+	int r = 0;
+	/* 2^(l-1) < d < 2^l */
+	while (p < d) {
+		p = p + p;
+		l = l + 1;
+	}
+	*shift = l - 1;
+	/* Try ceil(2^(63+l) / d) first */
+	r = long_div_bits (1, d, 63 + l, bits);
+	if ((r == 0) || ((d - r) <= (p / 2))) {
+		bits_to_hex (bits, (r != 0), dst);
+		return 0;
+	}
+	/* Otherwise use floor(2^64 * (2^l - d) / d) + 1 */
+	long_div_bits (p - d, d, 64, bits);
+	bits_to_hex (bits, 1, dst);
+	return 1;
+}
+
+/* Divides by a constant other than power of two
+ * by multiplying with its reciprocal */
+int _gen_cmd_div_magic(int d, int rem) {
+	char magic[20];
+	int shift = 0;
+	int fixup = div_magic (d, magic, &shift);
+	int a = vs_pop ();
+	int q = REG_DX;
+	int r = 0;
+	/* Product goes to rdx:rax, so both of them are needed */
+	reg_claim_ax_dx ();
+	if ((a == REG_AX) || (a == REG_DX)) {
+		r = reg_alloc ();
+		emit_mov (a, r);
+		a = r;
+	}
+	emit_ns (OP_MOVABS, magic, REG_AX);
+	emit_r (OP_MUL, a);
+	if (fixup) {
+		q = a;
+		if (rem) {
+			q = reg_alloc ();
+			emit_mov (a, q);
+		}
+		emit_rr (OP_SUB, REG_DX, q);
+		emit_nr (OP_SHR, 1, q);
+		emit_rr (OP_ADD, REG_DX, q);
+		reg_free (REG_DX);
+	}
+	if (shift) {
+		emit_nr (OP_SHR, shift, q);
+	}
+	reg_free (REG_AX);
+	if (rem) {
+		/* n - q * d */
+		emit_nr (OP_IMUL, d, q);
+		emit_rr (OP_SUB, q, a);
+		reg_free (q);
+		vs_push (a);
+	} else {
+		if (q != a) {
+			reg_free (a);
+		}
+		vs_push (q);
+	}
+	return 1;
+}
+
+int gen_cmd_mul() {
+	if (_gen_cmd_fold ('*', FOLD_MUL)) {
+		return 1;
+	}
+	if (vs_is_val (0, 1)) {
+		return gen_cmd_drop ();
+	}
+	if (vs_is_val (1, 1)) {
+		gen_cmd_swap ();
+		return gen_cmd_drop ();
+	}
+	if (vs_is_const (1)) {
+		gen_cmd_swap ();
+	}
+	if (vs_is_const (0)) {
+		return _gen_cmd_mul_n (vs_pop_const ());
+	}
+	return _gen_cmd_binop (OP_IMUL, 1);
+}
+
+int _gen_cmd_div(int rem) {
+	int b = 0;
+	int a = 0;
+	int r = 0;
+	char op = '/';
+	if (rem) {
+		op = '%';
+	}
+	if (_gen_cmd_fold (op, FOLD_LIM)) {
+		return 1;
+	}
+	if (!rem && vs_is_val (0, 1)) {
+		return gen_cmd_drop ();
+	}
+	if (vs_is_const (0)) {
+		b = vs_const_val (0);
+		if ((b > 1) && (b < FOLD_LIM)) {
+			vs_pop_const ();
+			r = log2_exact (b);
+			if (r < 0) {
+				return _gen_cmd_div_magic (b, rem);
+			}
+			a = vs_pop ();
+			if (rem) {
+				emit_nr (OP_AND, b - 1, a);
+			} else {
+				emit_nr (OP_SHR, r, a);
+			}
+			return vs_push (a);
+		}
+	}
+	b = vs_pop ();
+	a = vs_pop ();
+	/* Dividend goes to rdx:rax, so both of them are needed */
+	reg_claim_ax_dx ();
+	if ((b == REG_AX) || (b == REG_DX)) {
+		r = reg_alloc ();
+		emit_mov (b, r);
+		b = r;
+	}
+	if (a != REG_AX) {
+		emit_mov (a, REG_AX);
+		if (a != REG_DX) {
+			reg_free (a);
+		}
+	}
+	emit_rr (OP_XOR, REG_DX, REG_DX);
+	emit_r (OP_DIV, b);
+	reg_free (b);
+	if (rem) {
+		reg_free (REG_AX);
+		vs_push (REG_DX);
+	} else {
+		reg_free (REG_DX);
+		vs_push (REG_AX);
+	}
+	return 1;
+}
+
+int gen_cmd_div() {
+	return _gen_cmd_div (0);
+}
+
+int gen_cmd_mod() {
+	return _gen_cmd_div (1);
+}
+
+int gen_global(char *name) {
+	write_str (" .global ");
+	write_strln (name);
+	return 1;
+}
+
+/* Aligns what follows to a power of two number of bytes */
+int gen_align(int n) {
+	int k = 0;
+	while (bitmask (k) < n) {
+		k = k + 1;
+	}
+	if (k) {
+		write_str (" .p2align ");
+		write_numln (k);
+	}
+	return 1;
+}
+
+int gen_section(int sect) {
+	if (sect != section) {
+		section = sect;
 		if (section == SECTION_TEXT) {
 			write_strln (" .text");
 		} else if (section == SECTION_DATA) {
 			write_strln (" .data");
+		} else if (section == SECTION_RODATA) {
+			write_strln (" .section .rodata");
+		} else if (section == SECTION_BSS) {
+			write_strln (" .bss");
 		} else {
 			return 0;
 		}
@@ -805,25 +6918,153 @@ int gen_section(int sect) {
 	return 1;
 }
 
+/* Tests if two string literals read the same up to their quotes */
+int str_same(char *a, char *b) {
+	while ((*a == *b) && (*a != '"') && *a) {
+		a = a + 1;
+		b = b + 1;
+	}
+	return (*a == '"') && (*b == '"');
+}
+
+/**
+ * Finds a string literal in the pool, adds it if it is not there yet
+ *
+ * @param[in] s literal in the source, right after its opening quote
+ * @returns index of the literal, -1 if the pool is full
+ */
+int str_intern(char *s) {
+	int i = 0;
+	while (i < str_cnt) {
+		if (str_same (s, *((char**) str_src + i))) {
+			return i;
+		}
+		i = i + 1;
+	}
+	if (str_cnt == STR_SZ) {
+		write_err ("too many string literals");
+		return 0 - 1;
+	}
+	*((char**) str_src + str_cnt) = s;
+	str_cnt = str_cnt + 1;
+	return i;
+}
+
+/* Places string literals, each once, in read-only data. Characters
+ * the assembler would take for an escape or line end go as octal. */
+int gen_str_pool() {
+	char lbl[ID_SZ];
+	char *p = 0;
+	int c = 0;
+	int i = 0;
+	if (str_cnt) {
+		gen_section (SECTION_RODATA);
+	}
+	while (i < str_cnt) {
+		str_label (lbl, i);
+		write_str (lbl);
+		write_str (": .asciz ");
+		write_chr (34);
+		p = *((char**) str_src + i);
+		while (*p && (*p != '"')) {
+			c = *p & 255;
+			if ((c < 32) || (c > 126) || (c == 92)) {
+				write_chr (92);
+				write_chr ('0' + (c / 64));
+				write_chr ('0' + ((c / 8) % 8));
+				write_chr ('0' + (c % 8));
+			} else {
+				write_chr (c);
+			}
+			p = p + 1;
+		}
+		write_chr (34);
+		write_chr (10);
+		i = i + 1;
+	}
+	return 1;
+}
+
+/* Writes the counters to femtoc.prof once main returns */
+int gen_prof_dump() {
+	puts ("  push %rax                 # return code");
+	puts ("  movq $2, %rax             # call = OPEN");
+	puts ("  leaq __prof_file(%rip), %rdi");
+	puts ("  movq $577, %rsi           # O_WRONLY | O_CREAT | O_TRUNC");
+	puts ("  movq $420, %rdx           # mode = 0644");
+	puts ("  syscall");
+	puts ("  movq %rax, %rdi");
+	puts ("  movq $1, %rax             # call = WRITE");
+	puts ("  leaq __prof(%rip), %rsi");
+	puts ("  movq $__prof_end-__prof, %rdx");
+	puts ("  syscall");
+	puts ("  movq $3, %rax             # call = CLOSE");
+	puts ("  syscall");
+	puts ("  pop %rax");
+	return 1;
+}
+
+/* Places the counters of a program built with -fprofile-generate */
+int gen_prof_data() {
+	gen_section (SECTION_RODATA);
+	write_str ("__prof_file: .asciz ");
+	write_chr (34);
+	write_str ("femtoc.prof");
+	write_chr (34);
+	write_chr (10);
+	gen_section (SECTION_BSS);
+	gen_align (ALIGN_BIG);
+	write_strln ("__prof:");
+	write_str (" .space 8*");
+	write_numln (prof_cnt);
+	write_strln ("__prof_end:");
+	return 1;
+}
+
 int gen_start() {
 	/* Use `puts` here instead of all `gen_cmd_*` stuff */
 	puts ("# Generated with FemtoC");
 	puts ("# GNU Assembler [as, x86_64]");
-	puts (" .data");
+	puts (" .bss");
+	puts (" .p2align 6");
 	puts ("__mema:");
 	puts (" .space 65536");
 	puts ("__mema_end:");
 
 	/* Initialize data and stack pointers */
 	puts (" .text");
+	if (abi_sysv) {
+		/* Stays out of the way of the libc entry point if linked with
+		 * one, main sets the allocation pointer itself then */
+		puts (" .weak _start");
+		puts ("_start:");
+		puts ("  movq (%rsp), %rdi         # argc");
+		puts ("  leaq 8(%rsp), %rsi        # argv");
+		puts ("  call main");
+		if (prof_mode == PROF_GEN) {
+			gen_prof_dump ();
+		}
+		puts ("  movq %rax, %rdi           # return code = %rax");
+		puts ("  movq $60, %rax            # call = EXIT");
+		puts ("  syscall");
+		return 1;
+	}
 	puts (" .global _start");
 	puts ("_start:");
+	puts ("  movq (%rsp), %rax         # argc");
+	puts ("  leaq 8(%rsp), %rbx        # argv");
 	puts ("  leaq __mema(%rip), %rdi");
 	puts ("  leaq __mema_end-8(%rip), %rsp");
-	puts ("  movq %rsp, %rbp");
 
-	/* Call main() */
+	/* Call main(argc, argv) */
+	puts ("  push %rbx");
+	puts ("  push %rax");
+	puts ("  push %rbp");
+	puts ("  movq %rsp, %rbp");
 	puts ("  call main");
+	if (prof_mode == PROF_GEN) {
+		gen_prof_dump ();
+	}
 
 	/* Call exit(0) */
 	puts ("  movq %rax, %rdi           # return code = %rax");
@@ -832,27 +7073,411 @@ int gen_start() {
 	return 1;
 }
 
+/******************************************************************************
+* Call graph                                                                  *
+******************************************************************************/
+
+/* Copies a name to the call graph name pool */
+char *cg_name(char *s) {
+	char *p = cg_p;
+	int n = 0;
+	while (*(s + n)) {
+		n = n + 1;
+	}
+	if ((cg_p + n + 1) > ((char*) cg_names + CG_SZ)) {
+		cg_full = 1;
+		return NULL;
+	}
+	copy_memory (cg_p, s, n + 1);
+	cg_p = cg_p + n + 1;
+	return p;
+}
+
+/* Records a call from the last function, each callee only once */
+int cg_ref(char *name) {
+	int r = ref_cnt - 1;
+	while ((r >= 0) && (*((int*) ref_fn + r) == (fn_cnt - 1))) {
+		if (compare_str (name, *((char**) ref_name + r))) {
+			return 1;
+		}
+		r = r - 1;
+	}
+	if (ref_cnt == REF_SZ) {
+		cg_full = 1;
+		return 0;
+	}
+	*((int*) ref_fn + ref_cnt) = fn_cnt - 1;
+	*((char**) ref_name + ref_cnt) = cg_name (name);
+	ref_cnt = ref_cnt + 1;
+	return 1;
+}
+
+/* Finds a call in a line of inline assembly, returns 0 if there is none */
+int asm_callee(char *p, char *name) {
+	int n = 0;
+	while (*p && (*p != 10) && (*p != '}')) {
+		if ((*p == 'c') && (*(p + 1) == 'a') && (*(p + 2) == 'l')
+				&& (*(p + 3) == 'l') && is_space (*(p + 4))) {
+			p = p + 4;
+			while (is_space (*p)) {
+				p = p + 1;
+			}
+			while (is_id (*p) && (n < (ID_SZ - 1))) {
+				*(name + n) = *p;
+				n = n + 1;
+				p = p + 1;
+			}
+			*(name + n) = (char) 0;
+			return n > 0;
+		}
+		p = p + 1;
+	}
+	return 0;
+}
+
+/**
+ * Adds a function to the call graph along with calls it makes
+ * Calls are taken from buffered instructions, so the function has to
+ * be added after it is optimized but before it is written out.
+ *
+ * @param[in] name function name
+ * @param[in] sta start of the function in the output
+ * @returns 1
+ */
+int cg_add(char *name, char *sta) {
+	char buf[ID_SZ];
+	int i = 0;
+	if (fn_cnt == FN_SZ) {
+		cg_full = 1;
+		return 1;
+	}
+	*((char**) fn_name + fn_cnt) = cg_name (name);
+	*((char**) fn_sta + fn_cnt) = sta;
+	*((char*) fn_used + fn_cnt) = (char) 0;
+	fn_cnt = fn_cnt + 1;
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_CALL)
+				|| ((ins_get_op (i) == OP_JMP) && *((char*) ins_cc + i))) {
+			cg_ref (*((char**) ins_as + i));
+		} else if ((ins_get_op (i) == OP_ASM)
+				&& asm_callee (*((char**) ins_as + i), buf)) {
+			cg_ref (buf);
+		}
+		i = i + 1;
+	}
+	return 1;
+}
+
+/* Marks the end of the last function in the output */
+int cg_close() {
+	if (fn_cnt > 0) {
+		*((char**) fn_end + fn_cnt - 1) = out_p;
+	}
+	return 1;
+}
+
+/* Finds a function by name, -1 if it is not defined */
+int cg_find(char *name) {
+	int f = 0;
+	while (f < fn_cnt) {
+		if (compare_str (name, *((char**) fn_name + f))) {
+			return f;
+		}
+		f = f + 1;
+	}
+	return 0 - 1;
+}
+
+/* Marks functions reachable through calls from main */
+int cg_mark() {
+	int f = cg_find ("main");
+	int r = 0;
+	int changed = 1;
+	if (f < 0) {
+		return 0;
+	}
+	*((char*) fn_used + f) = (char) 1;
+	while (changed) {
+		changed = 0;
+		r = 0;
+		while (r < ref_cnt) {
+			if (*((char*) fn_used + *((int*) ref_fn + r))) {
+				f = cg_find (*((char**) ref_name + r));
+				if ((f >= 0) && !*((char*) fn_used + f)) {
+					*((char*) fn_used + f) = (char) 1;
+					changed = 1;
+				}
+			}
+			r = r + 1;
+		}
+	}
+	return 1;
+}
+
+/* Removes functions never called from main from the output */
+int cg_drop_unused() {
+	char *dst = result;
+	char *src = result;
+	int f = 0;
+	if (cg_full || !cg_mark ()) {
+		return 0;
+	}
+	while (f < fn_cnt) {
+		if (!*((char*) fn_used + f)) {
+			while (src < *((char**) fn_sta + f)) {
+				*dst = *src;
+				dst = dst + 1;
+				src = src + 1;
+			}
+			src = *((char**) fn_end + f);
+		}
+		f = f + 1;
+	}
+	while (src < out_p) {
+		*dst = *src;
+		dst = dst + 1;
+		src = src + 1;
+	}
+	out_p = dst;
+	*out_p = (char) 0;
+	return 1;
+}
+
+/******************************************************************************
+* Inline functions                                                            *
+******************************************************************************/
+
+/* Skips an expression up to the symbol that ends it, outside of
+ * parentheses: a semicolon, or the parenthesis closing a list */
+int skip_expr(char end) {
+	int depth = 0;
+	char quote = 0;
+	while (*src_p) {
+		if (quote) {
+			if (*src_p == quote) {
+				quote = 0;
+			} else if (*src_p == 92) {
+				src_p = src_p + 1;
+			}
+		} else if ((*src_p == '"') || (*src_p == 39)) {
+			quote = *src_p;
+		} else if ((*src_p == end) && !depth) {
+			return 1;
+		} else if (*src_p == '(') {
+			depth = depth + 1;
+		} else if (*src_p == ')') {
+			depth = depth - 1;
+		} else if (*src_p == 10) {
+			line_number = line_number + 1;
+		}
+		src_p = src_p + 1;
+	}
+	return 0;
+}
+
+/* Finds the expression a function body returns, NULL if the body
+ * has anything else in it */
+char *inl_body_expr(char *body) {
+	char *save = src_p;
+	int line = line_number;
+	char *expr = NULL;
+	src_p = body;
+	if (read_sym ('{') && read_sym_s ("return")) {
+		expr = src_p;
+		if (!skip_expr (';') || !read_sym (';') || !read_sym ('}')) {
+			expr = NULL;
+		}
+	}
+	src_p = save;
+	line_number = line;
+	return expr;
+}
+
+/* Copies data to the inline pool */
+char *inl_copy(char *s, int n) {
+	char *p = inl_p;
+	if ((inl_p + n) > ((char*) inl_pool + INL_POOL)) {
+		return NULL;
+	}
+	copy_memory (inl_p, s, n);
+	inl_p = inl_p + n;
+	return p;
+}
+
+/**
+ * Remembers a function just compiled as a candidate for inlining
+ * It must be a leaf function made of a single return statement, with
+ * no calls substituted in it either. Its code must be small unless it
+ * is declared inline.
+ *
+ * @param[in] name function name
+ * @param[in] body source of the function body
+ * @param[in] hint function is declared inline
+ * @returns 1 if the function can be inlined
+ */
+int inl_add(char *name, char *body, int hint) {
+	char *expr = inl_body_expr (body);
+	int i = 0;
+	int n = 0;
+	int argc = 0;
+	if (!expr || inl_used || (inl_cnt == INL_SZ)) {
+		return 0;
+	}
+	while (i < ins_cnt) {
+		if ((ins_get_op (i) == OP_CALL) || (ins_get_op (i) == OP_ASM)) {
+			return 0;
+		}
+		if (ins_is_code (i)) {
+			n = n + 1;
+		}
+		i = i + 1;
+	}
+	if ((n > INL_INS) && !hint) {
+		return 0;
+	}
+	/* Keep a copy of arguments list to resolve names at call sites */
+	n = 0;
+	while (*((char*) arguments + n)) {
+		argc = argc + 1;
+		n = n + 1 + type_sizeof (TYPE_INT);
+		while (*((char*) arguments + n) && (*((char*) arguments + n) != ' ')) {
+			n = n + 1;
+		}
+	}
+	*((char**) inl_args + inl_cnt) = inl_copy (arguments, n + 1);
+	*((char**) inl_name + inl_cnt) = inl_copy (name, ID_SZ);
+	if (!*((char**) inl_args + inl_cnt) || !*((char**) inl_name + inl_cnt)) {
+		return 0;
+	}
+	*((char**) inl_expr + inl_cnt) = expr;
+	*((int*) inl_argc + inl_cnt) = argc - 1;
+	inl_cnt = inl_cnt + 1;
+	return 1;
+}
+
+/* Finds an inline function taking given number of arguments,
+ * or any number if argc is -1; -1 if there is none */
+int inl_find(char *name, int argc) {
+	int f = 0;
+	if (!opt_level) {
+		return 0 - 1;
+	}
+	while (f < inl_cnt) {
+		if (compare_str (name, *((char**) inl_name + f))) {
+			if ((argc >= 0) && (*((int*) inl_argc + f) != argc)) {
+				return 0 - 1;
+			}
+			return f;
+		}
+		f = f + 1;
+	}
+	return 0 - 1;
+}
+
+/**
+ * Substitutes body of an inline function for a call to it
+ * The returned expression is compiled right at the call site, its
+ * arguments are read from where the call would have them on stack.
+ * With -abi=sysv they are evaluated in order, so the last one is on
+ * top instead. The result is left in rax, just like after a call.
+ *
+ * @param[in] f inline function index
+ * @returns 1 on success
+ */
+int parse_inline(int f) {
+	char *save = src_p;
+	int line = line_number;
+	char *vars = inl_vars;
+	int base = inl_base;
+	int order = inl_order;
+	int type = TYPE_INT;
+	int ok = 0;
+	/* The body addresses its arguments on machine stack */
+	vs_flush ();
+	inl_used = 1;
+	inl_vars = *((char**) inl_args + f);
+	inl_base = vs_mem_cnt ();
+	inl_order = abi_sysv * *((int*) inl_argc + f);
+	src_p = *((char**) inl_expr + f);
+	ok = parse_expr (&type);
+	if (ok) {
+		gen_cmd_pop_ret ();
+	}
+	src_p = save;
+	line_number = line;
+	inl_vars = vars;
+	inl_base = base;
+	inl_order = order;
+	return ok;
+}
+
 /******************************************************************************
 * Parse and process functions                                                 *
 ******************************************************************************/
 
+/* Parses arguments of __builtin_memcpy or __builtin_memset */
+int parse_builtin_mem(int fill) {
+	int argcnt = 0;
+	int type = TYPE_INT;
+	vs_flush ();
+	while (1) {
+		if (parse_expr (&type)) {
+			vs_settle ();
+			argcnt = argcnt + 1;
+			continue;
+		} else if (read_sym (',')) {
+			continue;
+		} else if (read_sym (')')) {
+			break;
+		}
+		return 0;
+	}
+	if (argcnt != 3) {
+		write_err ("three arguments expected");
+		return 0;
+	}
+	return gen_cmd_mem (fill);
+}
+
 int parse_invoke(char *name, int *ret_type) {
 	int argcnt = 0;
 	int n = 0;
 	int arg_list_len = 0;
 	int arg_item_len = 0;
-	char *arg_list_ptr = NULL;
-	char *argpos[ARG_SZ / (ID_SZ + 1) + 1];
+	int arg_list_ptr = 0;
+	int argpos[CALL_SZ];
+	int stack = 0;
 	int type = TYPE_INT;
+	/* Arguments go to registers, unless the body is substituted */
+	int regs = abi_sysv && (inl_find (name, 0 - 1) < 0);
 	*ret_type = TYPE_INT;
 
-	/* use argpos to locate where the output goes */
-	*(argpos + argcnt) = out_p;
+	/* Builtins are compiled in place, returning the destination */
+	if (compare_str (name, "__builtin_memcpy")
+			|| compare_str (name, "__builtin_memset")) {
+		*ret_type = type_reference (TYPE_NONE);
+		return parse_builtin_mem (compare_str (name, "__builtin_memset"));
+	}
+
+	/* Anything pending goes below the arguments */
+	vs_flush ();
+
+	/* use argpos to locate where the instructions go */
+	*(argpos + argcnt) = ins_cnt;
 
 	while (1) {
 		if (parse_expr (&type)) {
+			if (regs) {
+				vs_settle ();
+			} else {
+				vs_flush ();
+			}
 			argcnt = argcnt + 1;
-			*(argpos + argcnt) = out_p;
+			if (argcnt == CALL_SZ) {
+				write_err ("too many arguments");
+				return 0;
+			}
+			*(argpos + argcnt) = ins_cnt;
 			continue;
 		} else if (read_sym (',')) {
 			continue;
@@ -862,9 +7487,21 @@ int parse_invoke(char *name, int *ret_type) {
 		return 0;
 	}
 
+	if (regs && (argcnt > ARG_REGS)) {
+		/* The rest of them are passed on the stack */
+		stack = gen_cmd_args_stack (argcnt);
+	} else if (regs) {
+		/* Load the registers from the last argument on top */
+		n = argcnt;
+		while (n > 0) {
+			n = n - 1;
+			vs_pop_to (arg_reg (n));
+		}
+	}
+
 	/* Now that we have all our arguments prepared,
 	 * reverse them so the addressing is right */
-	if (argcnt > 1) {
+	else if (!abi_sysv && (argcnt > 1)) {
 		if (argcnt == 2) {
 			gen_cmd_swap ();
 		} else {
@@ -872,30 +7509,40 @@ int parse_invoke(char *name, int *ret_type) {
 			arg_list_ptr = *(argpos + argcnt);
 			arg_list_len = arg_list_ptr - *argpos;
 			/* Make a copy of arguments code right after itself */
-			copy_memory (arg_list_ptr, *argpos, arg_list_len);
+			ins_copy (arg_list_ptr, *argpos, arg_list_len);
 			n = 0;
 			while (n < argcnt) {
 				/* Populate original code with statements in reverse */
 				arg_item_len = *(argpos + n + 1) - *(argpos + n);
 				arg_list_ptr = arg_list_ptr - arg_item_len;
-				copy_memory (arg_list_ptr,
+				ins_copy (arg_list_ptr,
 						*(argpos + n) + arg_list_len,
 						arg_item_len);
 				n = n + 1;
 			}
-			/* Empty the memory after copy */
-			clear_memory (*argpos + arg_list_len, arg_list_len);
 		}
 	}
 
-	/* Call the subroutine */
-	gen_cmd_call (name);
+	/* Call the subroutine or substitute its body */
+	n = inl_find (name, argcnt);
+	if (n >= 0) {
+		if (!parse_inline (n)) {
+			return 0;
+		}
+	} else {
+		gen_cmd_call (name);
+	}
 
 	/* Drop the arguments */
-	n = 0;
-	while (n < argcnt) {
-		gen_cmd_drop ();
-		n = n + 1;
+	if (regs) {
+		n = 0;
+		while (n < argcnt) {
+			reg_free (arg_reg (n));
+			n = n + 1;
+		}
+		gen_cmd_dropn (stack);
+	} else {
+		gen_cmd_dropn (argcnt);
 	}
 
 	/* Determine the return type */
@@ -915,6 +7562,41 @@ int type_sizeof(int type) {
 	return 0;
 }
 
+/**
+ * Finds where a variable is stored
+ *
+ * @param[in] name variable name
+ * @param[out] type variable type
+ * @param[out] off offset from frame base for locals and arguments
+ * @returns VAR_FRAME, VAR_GLOBAL, VAR_INLINE or VAR_NONE if not found
+ */
+int find_storage(char *name, int *type, int *off) {
+	int idx = 0;
+	if (inl_vars) {
+		/* Only arguments and globals are seen from inline functions */
+		if (find_var (inl_vars, name, type, &idx) && idx) {
+			*off = idx;
+			return VAR_INLINE;
+		}
+		if (find_var (globals, name, type, &idx)) {
+			return VAR_GLOBAL;
+		}
+		return VAR_NONE;
+	}
+	if (find_var (locals, name, type, &idx)) {
+		*off = 0 - ((idx + 1) * type_sizeof (TYPE_INT));
+		return VAR_FRAME;
+	}
+	if (find_var (arguments, name, type, &idx)) {
+		*off = idx * type_sizeof (TYPE_INT);
+		return VAR_FRAME;
+	}
+	if (find_var (globals, name, type, &idx)) {
+		return VAR_GLOBAL;
+	}
+	return VAR_NONE;
+}
+
 int parse_sizeof() {
 	int type = TYPE_NONE;
 	if (!read_sym ('(')) {
@@ -937,6 +7619,7 @@ int parse_operand(int *type) {
 	char buf[ID_SZ];
 	char lbl[ID_SZ];
 	int idx = 0;
+	int storage = VAR_NONE;
 	char *tmp = 0;
 	int cast_type = TYPE_NONE;
 
@@ -963,16 +7646,16 @@ int parse_operand(int *type) {
 	} else if (read_sym ('&')) {
 		if (!read_id (buf)) {
 			return 0;
-		}
-		if (find_var (locals, buf, type, &idx)) {
-			gen_cmd_pushsf ();
-			gen_cmd_pushni ((idx + 1) * type_sizeof (TYPE_INT));
-			gen_cmd_sub ();
-		} else if (find_var (arguments, buf, type, &idx)) {
-			gen_cmd_pushsf ();
-			gen_cmd_pushni (idx * type_sizeof (TYPE_INT));
-			gen_cmd_add ();
-		} else if (find_var (globals, buf, type, &idx)) {
+		}
+		storage = find_storage (buf, type, &idx);
+		if (storage == VAR_FRAME) {
+			if (idx > 0) {
+				arg_addr = 1;
+			}
+			gen_cmd_push_addr (idx);
+		} else if (storage == VAR_INLINE) {
+			gen_cmd_push_arg (OP_LEA, idx);
+		} else if (storage == VAR_GLOBAL) {
 			gen_cmd_pushl (buf);
 		} else {
 			write_err ("undeclared identifier");
@@ -997,14 +7680,12 @@ int parse_operand(int *type) {
 			return read_sym (')');
 		}
 	} else if (read_sym ('"')) {
-		new_label (buf);
-		new_label (lbl);
-		gen_cmd_jump (buf);
-		gen_cmd_label (lbl);
-		write_str (" .byte");
+		idx = str_intern (src_p);
+		if (idx < 0) {
+			return 0;
+		}
+		str_label (lbl, idx);
 		read_str_const ();
-		write_strln (" 0");
-		gen_cmd_label (buf);
 		gen_cmd_pushl (lbl);
 		*type = type_reference (TYPE_CHR);
 		goto _parse_operand_good;
@@ -1035,25 +7716,26 @@ int parse_operand(int *type) {
 			if (!parse_invoke (buf, type)) {
 				return 0;
 			}
-			write_strln ("  push %rax");
+			gen_cmd_push_ret ();
 		} else {
 			if (find_var (constants, buf, type, &idx)) {
 				gen_cmd_pushni (*type);
 				*type = TYPE_INT;
-			} else if (find_var (locals, buf, type, &idx)) {
-				gen_cmd_pushsf ();
-				gen_cmd_pushni ((idx + 1) * type_sizeof (TYPE_INT));
-				gen_cmd_sub ();
-				gen_cmd_pushi (*type);
-			} else if (find_var (arguments, buf, type, &idx)) {
-				gen_cmd_pushsf ();
-				gen_cmd_pushni (idx * type_sizeof (TYPE_INT));
-				gen_cmd_add ();
-				gen_cmd_pushi (*type);
-			} else if (find_var (globals, buf, type, &idx)) {
-				gen_cmd_push_static (buf, *type);
 			} else {
-				return 0;
+				storage = find_storage (buf, type, &idx);
+				if (storage == VAR_FRAME) {
+					gen_cmd_push_local (idx, *type);
+				} else if (storage == VAR_INLINE) {
+					if (*type == TYPE_CHR) {
+						gen_cmd_push_arg (OP_MOVZB, idx);
+					} else {
+						gen_cmd_push_arg (OP_MOV, idx);
+					}
+				} else if (storage == VAR_GLOBAL) {
+					gen_cmd_push_static (buf, *type);
+				} else {
+					return 0;
+				}
 			}
 		}
 		goto _parse_operand_good;
@@ -1087,6 +7769,72 @@ int pointer_math(char left_type, char right_type) {
 	return 1;
 }
 
+/**
+ * Parses right operand of && or || so that it is only evaluated
+ * when the left operand on top of the operand stack does not
+ * decide the result on its own
+ *
+ * @param[in] is_or 1 for ||, 0 for &&
+ * @returns 1 on success, 0 on failure
+ */
+int parse_logic(int is_or) {
+	char lbl[ID_SZ];
+	int save = 0;
+	int type = TYPE_NONE;
+	int a = 0;
+	int cc = CC_NE;
+
+	if (vs_is_const (0)) {
+		if ((!vs_pop_const ()) != is_or) {
+			/* Result is known, so drop code of right operand */
+			vs_flush ();
+			save = ins_cnt;
+			if (!parse_operand (&type)) {
+				return 0;
+			}
+			ins_cnt = save;
+			vs_cnt = vs_cnt - 1;
+			if (*((char*) vs_kind + vs_cnt) == VS_REG) {
+				reg_free (*((char*) vs_reg + vs_cnt));
+			}
+			return vs_push_const (is_or);
+		}
+		if (!parse_operand (&type)) {
+			return 0;
+		}
+		return gen_cmd_bool ();
+	}
+
+	/* Left operand in a register holds the result if it decides */
+	new_label (lbl);
+	if (vs_is_flags ()) {
+		cc = vs_pop_const ();
+		a = reg_alloc ();
+		emit_setcc (cc, a);
+	} else {
+		a = vs_pop ();
+		emit_rr (OP_TEST, a, a);
+		if (is_or) {
+			emit_setcc (CC_NE, a);
+		}
+	}
+	vs_flush ();
+	if (!is_or) {
+		cc = cc_not (cc);
+	}
+	emit_jcc (cc, lbl);
+	reg_free (a);
+
+	/* Otherwise it is the right operand that does */
+	if (!parse_operand (&type)) {
+		return 0;
+	}
+	gen_cmd_bool ();
+	vs_pop_to (a);
+	emit_label_x ("", lbl, "");
+	return vs_push (a);
+}
+
 int parse_expr(int *type) {
 	int tmp_type = TYPE_NONE;
 
@@ -1095,12 +7843,13 @@ int parse_expr(int *type) {
 		return 0;
 	}
 
-	/* Any closing brackets, commas and semicolons
-	 * are considered the end of expression */
+	/* Any closing brackets, commas, semicolons and colons
+	 * of case labels are considered the end of expression */
 	while (!peek_sym (',')
 			&& !peek_sym (';')
 			&& !peek_sym (')')
-			&& !peek_sym (']')) {
+			&& !peek_sym (']')
+			&& !peek_sym (':')) {
 
 		if (read_sym ('+')) {
 			parse_operand (&tmp_type);
@@ -1160,14 +7909,9 @@ int parse_expr(int *type) {
 			gen_cmd_cmpne ();
 		} else if (read_sym ('&')) {
 			if (read_sym ('&')) {
-				if (!parse_operand (&tmp_type)) {
+				if (!parse_logic (0)) {
 					return 0;
 				}
-				gen_cmd_not ();
-				gen_cmd_swap ();
-				gen_cmd_not ();
-				gen_cmd_or ();
-				gen_cmd_not ();
 			} else {
 				if (!parse_operand (&tmp_type)) {
 					return 0;
@@ -1176,14 +7920,9 @@ int parse_expr(int *type) {
 			}
 		} else if (read_sym ('|')) {
 			if (read_sym ('|')) {
-				if (!parse_operand (&tmp_type)) {
+				if (!parse_logic (1)) {
 					return 0;
 				}
-				gen_cmd_not ();
-				gen_cmd_swap ();
-				gen_cmd_not ();
-				gen_cmd_and ();
-				gen_cmd_not ();
 			} else {
 				if (!parse_operand (&tmp_type)) {
 					return 0;
@@ -1211,22 +7950,26 @@ int parse_keyword_block() {
 		if (!parse_loop_for ()) {
 			return 0;
 		}
+	} else if (read_sym_s ("switch")) {
+		if (!parse_switch ()) {
+			return 0;
+		}
 	} else if (read_sym_s ("asm")) {
 		if (!read_sym ('{')) {
 			write_err ("`{` expected");
 			return 0;
 		}
-		write_strln("# ASM {");
+		vs_flush ();
+		emit_text ("# ASM {");
 		while (!read_sym ('}')) {
 			read_space ();
-			write_str ("  ");
+			ins_new (OP_ASM);
+			ins_src (K_SYM, 0, 0, src_p);
 			while ((*src_p != 10) && (*src_p != '}')) {
-				write_chr (*src_p);
 				src_p = src_p + 1;
 			}
-			write_chr (10);
 		}
-		write_strln("# } ASM");
+		emit_text ("# } ASM");
 	} else {
 		return 0;
 	}
@@ -1254,6 +7997,9 @@ int parse_block() {
 			if (parse_keyword_block ()) {
 				continue;
 			}
+			if (parse_case ()) {
+				continue;
+			}
 			if (parse_label ()) {
 				continue;
 			}
@@ -1269,10 +8015,12 @@ int parse_block() {
 }
 
 int parse_conditional() {
-	char lbl[ID_SZ];
+	char lbl1[ID_SZ];
+	char lbl2[ID_SZ];
+	char lbl3[ID_SZ];
 	int type = TYPE_INT;  /* don't care */
 
-	new_label (lbl);
+	new_label (lbl1);
 
 	if (!read_sym ('(')) {
 		return 0;
@@ -1286,9 +8034,15 @@ int parse_conditional() {
 		return 0;
 	}
 
-	gen_cmd_dup ();
+	/* Skip the block if condition does not hold */
 	gen_cmd_not ();
-	gen_cmd_nzjump (lbl);
+	gen_cmd_nzjump (lbl1);
+
+	/* Profiles count the block on its own */
+	if (prof_mode) {
+		new_label (lbl3);
+		gen_cmd_label (lbl3);
+	}
 
 	if (!read_sym (';')) {
 		if (!parse_block ()) {
@@ -1297,10 +8051,9 @@ int parse_conditional() {
 	}
 
 	if (read_sym_s ("else")) {
-		gen_cmd_label (lbl);
-
-		new_label (lbl);
-		gen_cmd_nzjump (lbl);
+		new_label (lbl2);
+		gen_cmd_jump (lbl2);
+		gen_cmd_label (lbl1);
 
 		if (!read_sym (';')) {
 			if (!parse_block ()) {
@@ -1308,10 +8061,9 @@ int parse_conditional() {
 			}
 		}
 
-		gen_cmd_label (lbl);
+		gen_cmd_label (lbl2);
 	} else {
-		gen_cmd_label (lbl);
-		gen_cmd_drop ();
+		gen_cmd_label (lbl1);
 	}
 
 	return 1;
@@ -1320,15 +8072,18 @@ int parse_conditional() {
 int parse_loop_for() {
 	char lbl1[ID_SZ];
 	char lbl2[ID_SZ];
-	char lbl3[ID_SZ];
 	char lbl4[ID_SZ];
 	char *tmp_sta = 0;
 	char *tmp_end = 0;
+	char *tmp_def = sw_def;
+	char *step = 0;
+	char *save = 0;
+	int step_line = 0;
+	int line = 0;
 	int type = TYPE_INT; /* default */
 
 	new_label (lbl1);
 	new_label (lbl2);
-	new_label (lbl3);
 	new_label (lbl4);
 
 	/* Remember parent loop labels if any */
@@ -1336,6 +8091,8 @@ int parse_loop_for() {
 	tmp_end = lbl_end;
 	lbl_sta = lbl2;
 	lbl_end = lbl4;
+	/* Cases of a switch around can not be placed inside */
+	sw_def = 0;
 
 	if (!read_sym ('(')) {
 		return 0;
@@ -1363,11 +8120,26 @@ int parse_loop_for() {
 	gen_cmd_not ();
 	gen_cmd_nzjump (lbl4);
 
-	gen_cmd_jump (lbl3);
+	/* Third statement goes after the body, so the body needs no
+	 * jumps to get there and back */
+	step = src_p;
+	step_line = line_number;
+	if (!skip_expr (')') || !read_sym (')')) {
+		return 0;
+	}
+
+	if (!read_sym (';')) {
+		if (!parse_block ()) {
+			return 0;
+		}
+	}
 
 	gen_cmd_label (lbl2);
 
-	/* Third statement */
+	save = src_p;
+	line = line_number;
+	src_p = step;
+	line_number = step_line;
 	while (!read_sym (')')) {
 		if (!parse_statement (&type)) {
 			return 0;
@@ -1376,23 +8148,16 @@ int parse_loop_for() {
 			continue;
 		}
 	}
+	src_p = save;
+	line_number = line;
 
 	gen_cmd_jump (lbl1);
-
-	gen_cmd_label (lbl3);
-
-	if (!read_sym (';')) {
-		if (!parse_block ()) {
-			return 0;
-		}
-	}
-
-	gen_cmd_jump (lbl2);
 	gen_cmd_label (lbl4);
 
 	/* Restore parent loop break label */
 	lbl_sta = tmp_sta;
 	lbl_end = tmp_end;
+	sw_def = tmp_def;
 
 	return 1;
 }
@@ -1402,6 +8167,7 @@ int parse_loop_while() {
 	char lbl2[ID_SZ];
 	char *tmp_sta = 0;
 	char *tmp_end = 0;
+	char *tmp_def = sw_def;
 	int type = TYPE_INT; /* default */
 
 	new_label (lbl1);
@@ -1412,6 +8178,7 @@ int parse_loop_while() {
 	tmp_end = lbl_end;
 	lbl_sta = lbl1;
 	lbl_end = lbl2;
+	sw_def = 0;
 
 	if (!read_sym ('(')) {
 		return 0;
@@ -1442,32 +8209,206 @@ int parse_loop_while() {
 	/* Restore parent loop break label */
 	lbl_sta = tmp_sta;
 	lbl_end = tmp_end;
+	sw_def = tmp_def;
+
+	return 1;
+}
+
+int parse_switch() {
+	char lbl1[ID_SZ];
+	char lbl2[ID_SZ];
+	char lbl3[ID_SZ];
+	char *tmp_end = lbl_end;
+	char *tmp_def = sw_def;
+	int tmp_base = sw_base;
+	int type = TYPE_INT; /* default */
+
+	new_label (lbl1);
+	new_label (lbl2);
+	*lbl3 = (char) 0;
+
+	if (!read_sym ('(')) {
+		return 0;
+	}
+	if (!parse_expr (&type)) {
+		return 0;
+	}
+	if (!read_sym (')')) {
+		return 0;
+	}
+
+	/* Cases are only known after the body, so the value waits in
+	 * rax while the code dispatching it is placed there */
+	vs_pop_to (REG_AX);
+	reg_free (REG_AX);
+	gen_cmd_jump (lbl1);
+
+	/* Break leaves the switch, continue still goes to the loop */
+	lbl_end = lbl2;
+	sw_def = lbl3;
+	sw_base = sw_cnt;
+
+	if (!parse_block ()) {
+		return 0;
+	}
+
+	gen_cmd_jump (lbl2);
+	gen_cmd_label (lbl1);
+	if (*lbl3) {
+		gen_cmd_switch (sw_base, sw_cnt, ins_name ("", lbl3, ""));
+	} else {
+		gen_cmd_switch (sw_base, sw_cnt, ins_name ("", lbl2, ""));
+	}
+	gen_cmd_label (lbl2);
+
+	/* Restore parent switch and break label */
+	sw_cnt = sw_base;
+	sw_base = tmp_base;
+	sw_def = tmp_def;
+	lbl_end = tmp_end;
 
 	return 1;
 }
 
-int parse_gvar(int type, char *name) {
+/* Reads a case or default label of the nearest switch */
+int parse_case() {
+	char lbl[ID_SZ];
 	char num[ID_SZ];
-	int numi = 0;
-	int tmp = 0;
+	char *big = NULL;
+	int type = TYPE_INT; /* default */
+	int v = 0;
+	int n = 0;
+	int i = sw_cnt;
 
-	gen_section (SECTION_DATA);
-	gen_global (name);
-	gen_cmd_label (name);
-	if (type == TYPE_CHR) {
-		write_str (" .byte ");
+	if (read_sym_s ("default")) {
+		if (!sw_def || *sw_def) {
+			write_err ("unexpected default");
+			return 0;
+		}
+		new_label (sw_def);
+		copy_memory (lbl, sw_def, ID_SZ);
+	} else if (read_sym_s ("case")) {
+		if (!sw_def) {
+			write_err ("unexpected case");
+			return 0;
+		}
+		if (sw_cnt == SW_SZ) {
+			write_err ("too many cases");
+			return 0;
+		}
+
+		/* Literals of ten digits and more are no constants,
+		 * see gen_cmd_pushns, these are kept as they are */
+		read_space ();
+		while (is_digit (*(src_p + n))) {
+			n = n + 1;
+		}
+		if ((n >= 10) && (n < ID_SZ)) {
+			read_number (num);
+			big = ins_name ("", num, "");
+			while (i > sw_base) {
+				if (compare_str (*((char**) sw_big + i - 1), big)) {
+					write_err ("duplicate case");
+					return 0;
+				}
+				i = i - 1;
+			}
+			i = sw_cnt;
+		} else {
+			if (!parse_expr (&type)) {
+				return 0;
+			}
+			if (!vs_is_const (0)) {
+				write_err ("constant expected");
+				return 0;
+			}
+			v = vs_pop_const ();
+
+			/* Keep cases sorted by value, long literals last */
+			while ((i > sw_base) && (*((char**) sw_big + i - 1)
+						|| (*((int*) sw_val + i - 1) > v))) {
+				*((int*) sw_val + i) = *((int*) sw_val + i - 1);
+				*((char**) sw_lbl + i) = *((char**) sw_lbl + i - 1);
+				*((char**) sw_big + i) = *((char**) sw_big + i - 1);
+				i = i - 1;
+			}
+			if ((i > sw_base) && (*((int*) sw_val + i - 1) == v)) {
+				write_err ("duplicate case");
+				return 0;
+			}
+		}
+		new_label (lbl);
+		*((int*) sw_val + i) = v;
+		*((char**) sw_lbl + i) = ins_name ("", lbl, "");
+		*((char**) sw_big + i) = big;
+		sw_cnt = sw_cnt + 1;
 	} else {
-		write_str (" .quad ");
+		return 0;
+	}
+
+	if (!read_sym (':')) {
+		write_err ("`:` expected");
+		return 0;
+	}
+	gen_cmd_label (lbl);
+	return 1;
+}
+
+/**
+ * Reads an alignment attribute of a global, if there is one:
+ * __attribute__((aligned(N))), N being a power of two
+ *
+ * @param[in,out] align alignment in bytes, raised to N
+ * @returns 0 if the attribute is malformed
+ */
+int parse_aligned(int *align) {
+	char num[ID_SZ];
+	int n = 0;
+	int tmp = 0;
+
+	if (!read_sym_s ("__attribute__")) {
+		return 1;
+	}
+	if (!read_sym ('(') || !read_sym ('(') || !read_sym_s ("aligned")
+			|| !read_sym ('(')) {
+		write_err ("aligned attribute expected");
+		return 0;
+	}
+	read_space ();
+	if (read_number (num)) {
+		n = strtonum (num);
+	} else if (!read_id (num) || !find_var (constants, num, &n, &tmp)) {
+		write_err ("constant expected");
+		return 0;
+	}
+	if (!read_sym (')') || !read_sym (')') || !read_sym (')')) {
+		write_err ("`)` expected");
+		return 0;
+	}
+	if ((n <= 0) || (n & (n - 1))) {
+		write_err ("alignment must be a power of two");
+		return 0;
+	}
+	if (n > *align) {
+		*align = n;
 	}
+	return 1;
+}
+
+/* Zero-initialized globals go to .bss and take no room in the file */
+int parse_gvar(int type, char *name, int align) {
+	char num[ID_SZ];
+	int numi = 0;
+	int tmp = 0;
+	int size = type_sizeof (TYPE_INT);
 
 	read_space ();
 	if (read_number (num)) {
-		write_strln (num);
+		numi = strtonum (num);
 	} else if (read_id (num)) {
 		if (!find_var (constants, num, &numi, &tmp)) {
 			return 0;
 		}
-		write_numln (numi);
 	} else {
 		return 0;
 	}
@@ -1476,29 +8417,49 @@ int parse_gvar(int type, char *name) {
 		return 0;
 	}
 
+	if (type == TYPE_CHR) {
+		size = 1;
+	}
+	if (size > align) {
+		align = size;
+	}
+	if (numi) {
+		gen_section (SECTION_DATA);
+	} else {
+		gen_section (SECTION_BSS);
+	}
+	gen_global (name);
+	gen_align (align);
+	write_str (name);
+	write_strln (":");
+	if (!numi) {
+		write_str (" .zero ");
+		write_numln (size);
+	} else if (type == TYPE_CHR) {
+		write_str (" .byte ");
+		write_numln (numi);
+	} else {
+		write_str (" .quad ");
+		write_numln (numi);
+	}
+
 	store_var (globals, type, name);
 	return 1;
 }
 
-int parse_garr(int type, char *name) {
+/* Arrays can not be initialized, all of them go to .bss */
+int parse_garr(int type, char *name, int align) {
 	char num[ID_SZ];
 	int tmp = 0;
 	int numi = 0;
-
-	gen_section (SECTION_DATA);
-	gen_global (name);
-	gen_cmd_label (name);
-	write_str (" .space ");
-	write_num (type_sizeof (type));
-	write_str ("*");
+	int size = type_sizeof (type);
 
 	if (read_number (num)) {
-		write_strln (num);
+		numi = strtonum (num);
 	} else if (read_id (num)) {
 		if (!find_var (constants, num, &numi, &tmp)) {
 			return 0;
 		}
-		write_numln (numi);
 	} else {
 		return 0;
 	}
@@ -1506,10 +8467,27 @@ int parse_garr(int type, char *name) {
 	if (!read_sym (']')) {
 		return 0;
 	}
+	if (!parse_aligned (&align)) {
+		return 0;
+	}
 	if (!read_sym (';')) {
 		return 0;
 	}
 
+	if ((size * numi) >= ALIGN_BIG) {
+		size = ALIGN_BIG;
+	}
+	if (size > align) {
+		align = size;
+	}
+	gen_section (SECTION_BSS);
+	gen_global (name);
+	gen_align (align);
+	write_str (name);
+	write_strln (":");
+	write_str (" .zero ");
+	write_numln (type_sizeof (type) * numi);
+
 	store_var (globals, type | TYPE_ARR, name);
 	return 1;
 }
@@ -1533,20 +8511,22 @@ int parse_label() {
 
 int parse_statement() {
 	int idx = 0;
+	int storage = VAR_NONE;
 	char id[ID_SZ];
 	char num[ID_SZ];
 
 	int dst_type = TYPE_NONE;
 	int type = TYPE_NONE;
 
-	/* Show line of statement as comment */
-	char *tmp = src_p;
-	write_str ("# St.: ");
-	while ((*tmp != ';') && (*tmp != 10) && (*tmp != '{')) {
-		write_chr (*tmp);
-		tmp = tmp + 1;
+	/* Nothing more is compiled after an error */
+	if (err_cnt) {
+		return 0;
 	}
-	write_chr (10);
+
+	/* Show line of statement as comment */
+	read_space ();
+	ins_new (OP_STMT);
+	ins_src (K_SYM, 0, 0, src_p);
 
 	/* Assignment by pointer */
 	if (read_sym ('*')) {
@@ -1577,7 +8557,7 @@ int parse_statement() {
 			return 0;
 		}
 		/* save it */
-		_gen_cmd_pop_rax ();
+		gen_cmd_pop_ret ();
 		/* jump to end of function */
 		char *id_p = id;
 		char *fn_p = locals + 1 + type_sizeof (TYPE_INT);
@@ -1622,20 +8602,11 @@ int parse_statement() {
 				write_err ("duplicate identifier");
 				return 0;
 			} else {
-				/* In a case of new allocation we need to provide
-				 * space on stack for it so that we a have a place
-				 * to store the value */
-				gen_cmd_dup ();
-
-				/* Allocate and point */
+				/* The frame has room for it already */
 				store_var (locals, dst_type, id);
-				find_var (locals, id, &dst_type, &idx);
-				gen_cmd_pushsf ();
-				gen_cmd_pushni ((idx + 1) * type_sizeof (TYPE_INT));
-				gen_cmd_sub ();
+				find_storage (id, &dst_type, &idx);
+				gen_cmd_pop_local (idx, dst_type);
 			}
-			gen_cmd_swap ();
-			gen_cmd_popi (dst_type);
 		} else if (read_sym ('[')) {
 			/* Local array definition.
 			 * It is not placed on stack but instead dynamically
@@ -1643,7 +8614,7 @@ int parse_statement() {
 			 * stack */
 
 			/* Initialize array pointer */
-			write_strln ("  push %rdi");
+			gen_cmd_push_pool ();
 
 			/* Calculate array length and leave it on the stack */
 			if (!parse_expr (&type)) {
@@ -1656,19 +8627,17 @@ int parse_statement() {
 			/* Derive array size from length and element type */
 			if (type_sizeof (dst_type) > 1)
 			{
-				write_str ("  movq $");
-				write_num (type_sizeof (dst_type));
-				write_strln (", %rax");
-				write_strln ("  push %rax");
+				gen_cmd_pushni (type_sizeof (dst_type));
 				gen_cmd_mul ();
 			}
 
 			/* Local arrays are considered pointers */
 			store_var (locals, type_reference (dst_type), id);
 
-			/* Allocate memory for the array */
-			_gen_cmd_pop_rax ();
-			write_strln ("  add %rax, %rdi");
+			/* Allocate memory for the array, store the pointer */
+			gen_cmd_alloc_pool ();
+			find_storage (id, &dst_type, &idx);
+			gen_cmd_pop_local (idx, dst_type);
 		} else {
 			write_err ("definition = or [ expected");
 			return 0;
@@ -1699,22 +8668,15 @@ int parse_statement() {
 		if (!parse_expr (&type)) {
 			return 0;
 		}
-		if (find_var (locals, id, &dst_type, &idx)) {
-			gen_cmd_pushsf ();
-			gen_cmd_pushni ((idx + 1) * type_sizeof (TYPE_INT));
-			gen_cmd_sub ();
-		} else if (find_var (arguments, id, &dst_type, &idx)) {
-			gen_cmd_pushsf ();
-			gen_cmd_pushni (idx * type_sizeof (TYPE_INT));
-			gen_cmd_add ();
-		} else if (find_var (globals, id, &dst_type, &idx)) {
-			gen_cmd_pushl (id);
+		storage = find_storage (id, &dst_type, &idx);
+		if (storage == VAR_FRAME) {
+			gen_cmd_pop_local (idx, dst_type);
+		} else if (storage == VAR_GLOBAL) {
+			gen_cmd_pop_static (id, dst_type);
 		} else {
 			write_err ("undefined identifier");
 			return 0;
 		}
-		gen_cmd_swap ();
-		gen_cmd_popi (dst_type);
 	}
 
 	else {
@@ -1750,8 +8712,14 @@ int parse_argslist() {
 	return 1;
 }
 
-int parse_func(int type, char *name) {
+int parse_func(int type, char *name, int hint) {
 	char *save = out_p;
+	char *sta = NULL;
+	char *body = NULL;
+	int argc = 0;
+	int slots = 0;
+	int frame = 0;
+	int n = 0;
 
 	/* Put function name to locals and arguments lists
 	 * so that the first entry index starts with 1 */
@@ -1761,25 +8729,64 @@ int parse_func(int type, char *name) {
 	/* Put function name to globals list */
 	store_var (globals, type, name);
 
+	/* Start with empty operand stack */
+	vs_reset ();
+
 	/* Put label */
 	gen_section (SECTION_TEXT);
+	sta = out_p;
 	gen_global (name);
-	gen_cmd_label (name);
+	gen_cmd_label_x ("", name, "");
+
+	/* Arguments */
+	if (!parse_argslist ()) {
+		return 0;
+	}
+	argc = count_vars (arguments) - 1;
+	arg_addr = 0;
+
+	if (abi_sysv) {
+		/* Arguments go to the slots callers push them to by default,
+		 * those past the registers are copied from above the return
+		 * address, each one at the same distance from the top */
+		n = argc;
+		while (n > 0) {
+			n = n - 1;
+			if (n >= ARG_REGS) {
+				ins_new (OP_PUSH);
+				ins_src (K_MEM, REG_SP,
+						(argc - ARG_REGS) * type_sizeof (TYPE_INT), NULL);
+			} else {
+				emit_push (arg_reg (n));
+			}
+		}
+		/* Save caller base, set a new base */
+		emit_push (REG_BP);
+		emit_rr (OP_MOV, REG_SP, REG_BP);
+		/* Save allocation pointer in place of return address */
+		emit_push (alloc_reg);
+	}
 
 	/* Save allocation pointer on stack */
-	write_strln ("  push %rdi");
+	emit_push (alloc_reg);
 	/* ..and reserve dummy local variable with index 1 */
 	store_var (locals, TYPE_INT, "?");
 
-	/* Arguments */
-	if (!parse_argslist ()) {
-		return 0;
+	/* Programs linked with libc do not run our entry point */
+	if (abi_sysv && compare_str (name, "main")) {
+		emit_sr (OP_LEA, "__mema", alloc_reg);
 	}
 
+	/* Room for all locals, its size is known after the body */
+	emit_nr (OP_SUB, 0, REG_SP);
+	frame = ins_cnt - 1;
+
 	/* Allow for declarations */
 	if (read_sym (';')) {
 		/* Nothing to be done here */
 		out_p = save;
+		*out_p = (char) 0;
+		ins_reset ();
 		goto parse_func_skip;
 	}
 
@@ -1788,23 +8795,85 @@ int parse_func(int type, char *name) {
 		return 0;
 	}
 	unread_sym ();
+	body = src_p;
+	inl_used = 0;
+	prof_fn = gen_prof ();
 
 	/* Function body */
 	if (!parse_block ()) {
 		return 0;
 	}
+	/* Functions a profile never saw run are not worth inlining,
+	 * those running often are inlined whatever their size */
+	if ((prof_fn > 0) && (prof_fn >= (prof_max / PROF_HOT))) {
+		hint = 1;
+	}
+	if (prof_fn || hint) {
+		inl_add (name, body, hint);
+	}
+
+	/* Patch the frame size in, keeping calls aligned */
+	n = count_vars (locals) - 2;
+	if (abi_sysv) {
+		n = n + (n % 2);
+	}
+	if (n > 0) {
+		*((int*) ins_an + frame) = n * type_sizeof (TYPE_INT);
+	} else {
+		ins_set_op (frame, OP_NOP);
+	}
+
+	/* Save the rest of argument registers if they may be read */
+	slots = arg_slots (argc);
+	if (abi_sysv && (slots > argc)) {
+		n = ins_of_label (name) + 1;
+		ins_open (n, slots - argc);
+		while (slots > argc) {
+			slots = slots - 1;
+			ins_put (n, OP_PUSH, K_REG, arg_reg (slots % ARG_REGS), 0, 0);
+			*((char*) ins_bk + n) = (char) K_NONE;
+			n = n + 1;
+		}
+		slots = arg_slots (argc);
+	}
 
 	/* Default return value */
-	write_strln ("  xor %rax, %rax");
+	emit_rr (OP_XOR, REG_AX, REG_AX);
 
 	/* Function end label */
 	gen_cmd_label_x ("__", name, "_end");
 
 	/* Return statement */
-	write_strln ("  movq %rbp, %rsp");
-	write_strln ("  leaq -16(%rsp), %rsp");
-	write_strln ("  pop %rdi");
-	write_strln ("  ret");
+	emit_rr (OP_MOV, REG_BP, REG_SP);
+	if (abi_sysv) {
+		ins_new (OP_LEA);
+		ins_src (K_MEM, REG_SP, -8, NULL);
+		ins_dst (K_REG, REG_SP, 0, NULL);
+		emit_pop (alloc_reg);
+		emit_pop (REG_BP);
+		if (slots) {
+			ins_new (OP_LEA);
+			ins_src (K_MEM, REG_SP, slots * type_sizeof (TYPE_INT), NULL);
+			ins_dst (K_REG, REG_SP, 0, NULL);
+		}
+	} else {
+		ins_new (OP_LEA);
+		ins_src (K_MEM, REG_SP, -16, NULL);
+		ins_dst (K_REG, REG_SP, 0, NULL);
+		emit_pop (alloc_reg);
+	}
+	ins_new (OP_RET);
+	ins_optimize ();
+	if (opt_level && abi_sysv) {
+		/* Callers do not set up anything for the frame of the callee */
+		frame_elide (type_sizeof (TYPE_INT) * (slots + 1));
+	}
+	cg_add (name, sta);
+	if (opt_level && !abi_sysv) {
+		leaf_copy (name);
+	}
+	ins_flush ();
+	cg_close ();
 
 parse_func_skip:
 	/* Erase lists of args and locals */
@@ -1846,8 +8915,10 @@ int parse_preprocessor() {
 int parse_root() {
 	char id[ID_SZ];
 	int type = 0;
+	int hint = 0;
+	int align = 0;
 
-	while (*src_p) {
+	while (*src_p && !err_cnt) {
 		/* Preprocessor mockup (allows the parser to ignore pp) */
 		if (read_sym ('#')) {
 			if (!parse_preprocessor ()) {
@@ -1858,7 +8929,9 @@ int parse_root() {
 		if (!*src_p) {
 			break;
 		}
-		/* Everything else must start with a type and id */
+		/* Everything else must start with a type and id,
+		 * functions may be declared inline */
+		hint = read_sym_s ("inline");
 		if (!read_type (&type)) {
 			write_err ("type expected");
 			return 0;
@@ -1867,21 +8940,26 @@ int parse_root() {
 			write_err ("identifier expected");
 			return 0;
 		}
+		align = 0;
 		/* Function declaration */
 		if (read_sym ('(')) {
-			if (!parse_func (type, id)) {
+			if (!parse_func (type, id, hint)) {
 				break;
 			}
 		}
+		/* Alignment attribute of a global */
+		else if (!parse_aligned (&align)) {
+			break;
+		}
 		/* Global variable declaration and initialization */
 		else if (read_sym ('=')) {
-			if (!parse_gvar (type, id)) {
+			if (!parse_gvar (type, id, align)) {
 				break;
 			}
 		}
 		/* Global array declaration */
-		else if (read_sym ('[')) {
-			if (!parse_garr (type, id)) {
+		else if (!align && read_sym ('[')) {
+			if (!parse_garr (type, id, align)) {
 				break;
 			}
 		} else {
@@ -1898,10 +8976,40 @@ int parse_root() {
 * Entry point                                                                 *
 ******************************************************************************/
 
-int main() {
-	char last_written_str[LINE_SZ];
+/* Reads command line options, returns 0 on unknown ones */
+int read_options(int argc, char **argv) {
+	int n = 1;
+	while (n < argc) {
+		if (compare_str (*(argv + n), "-O")) {
+			opt_level = 1;
+		} else if (compare_str (*(argv + n), "-abi=sysv")) {
+			abi_sysv = 1;
+			alloc_reg = REG_BX;
+		} else if (compare_str (*(argv + n), "-mavx2")) {
+			vec_avx = 1;
+		} else if (compare_str (*(argv + n), "-fprofile-generate")) {
+			prof_mode = PROF_GEN;
+		} else if (compare_str (*(argv + n), "-fprofile-use")) {
+			prof_mode = PROF_USE;
+		} else {
+			return 0;
+		}
+		n = n + 1;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
 	int  temp = 0;
 
+	if (!read_options (argc, argv)) {
+		puts ("# Unknown option, usage: cc [-O] [-abi=sysv] [-mavx2] [-fprofile-generate|-fprofile-use] < source > output");
+		return 1;
+	}
+	if ((prof_mode == PROF_USE) && !prof_load ()) {
+		puts ("# No profile in femtoc.prof, compiling without it");
+	}
+
 	clear_memory (source, SRC_SZ);
 	clear_memory (result, OUT_SZ);
 	clear_memory (locals, LOC_SZ);
@@ -1911,7 +9019,9 @@ int main() {
 
 	src_p = source;
 	out_p = result;
-	last_str = last_written_str;
+	cg_p = cg_names;
+	inl_p = inl_pool;
+	ins_reset ();
 
 	while (1) {
 		/* Read by character */
@@ -1932,14 +9042,21 @@ int main() {
 
 	/* Here we go */
 	parse_root ();
+	if (prof_mode == PROF_GEN) {
+		gen_prof_data ();
+	}
+	gen_str_pool ();
 
 	if (find_var (globals, "main", &temp, &temp)) {
 		/* only generate prologue when main function defined */
+		if (opt_level) {
+			cg_drop_unused ();
+		}
 		gen_start ();
 	}
 
 	puts (result);
-	if (!*src_p) {
+	if (!*src_p && !err_cnt) {
 		puts ("# The end: no errors encountered");
 	} else {
 		puts ("# Error(s) found!");
@@ -0,0 +1,40 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Checking global placement test"
+echo "${CG}${TITLE0} begin${RC}"
+
+IFILE=$IDIR/align
+OFILE=$TDIR/align
+
+# Section and .p2align of each global, '-' for none
+cat > $TDIR/align_key <<END
+seven: .data 3
+zero: .bss 3
+flag: .data 4
+byte0: .bss -
+counter: .bss 6
+line: .bss 7
+small: .bss -
+few: .bss 3
+big: .bss 6
+END
+
+for FCFLAGS in "" "-O -abi=sysv"; do
+	echo "Compiling with ${FCFLAGS:-no options}..."
+	cat $IFILE.c | ../cc $FCFLAGS > $OFILE.s
+	awk '/^ \.(bss|data|text)$/ { sec = $1 }
+		/^ \.section/ { sec = $2 }
+		/^ \.p2align/ { al = $2 }
+		/^[a-z_0-9]+:$/ { print $1, sec, (al == "" ? "-" : al); al = "" }' $OFILE.s \
+		| grep -E "^(seven|zero|flag|byte0|counter|line|small|few|big):" > $OFILE.txt
+	if ! diff $TDIR/align_key $OFILE.txt; then
+		echo "${CR}Globals misplaced${RC}"
+		exit 1
+	fi
+	echo "...all globals in place"
+	rm $OFILE.s $OFILE.txt
+done
+rm $TDIR/align_key
+
+echo "${CG}${TITLE0} end${RC}"
@@ -0,0 +1,30 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Checking vector loops test"
+echo "${CG}${TITLE0} begin${RC}"
+
+IFILE=$IDIR/vector
+OFILE=$TDIR/vector
+
+for FCFLAGS in "-O" "-O -mavx2"; do
+	if [[ $FCFLAGS == *-mavx2* ]]; then
+		MN=vmovdqu
+	else
+		MN=movdqu
+	fi
+	echo "Compiling with $FCFLAGS..."
+	cat $IFILE.c | ../cc $FCFLAGS > $OFILE.s
+	for FN in fill_up fill_count copy_up copy_ptr fill_int copy_int; do
+		# The function, or its frameless copy, up to its end label
+		if ! sed -n "/^\(__\)\?${FN}\(_leaf\)\?:$/,/_end:$/p" $OFILE.s \
+				| grep -q "^ *$MN "; then
+			echo "${CR}No $MN in $FN${RC}"
+			exit 1
+		fi
+	done
+	echo "...all loops use $MN"
+	rm $OFILE.s
+done
+
+echo "${CG}${TITLE0} end${RC}"
@@ -0,0 +1,34 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Comparing outputs with and without -O test"
+echo "${CG}${TITLE0} begin${RC}"
+
+# The order is up to the compiler, so these are not compared with gcc
+for SAMPLE in order; do
+	for ABI in "" "-abi=sysv"; do
+		echo "Sample $SAMPLE ${ABI}..."
+		OFILE1=$TDIR/temp1
+		OFILE2=$TDIR/temp2
+
+		FCFLAGS="$ABI"
+		source ./compile-fc.sh
+		echo "Executing sample..."
+		./$ODIR/${SAMPLE}_fc > $OFILE1
+		FCFLAGS="-O $ABI"
+		source ./compile-fc.sh
+		echo "Executing optimized sample..."
+		./$ODIR/${SAMPLE}_fc > $OFILE2
+		echo "Calculating diff..."
+		if ! cmp $OFILE1 $OFILE2; then
+			echo "${CR}Files not matching${RC}"
+			exit 1
+		else
+			echo "...files match"
+		fi
+		echo "Clean up"
+		rm $ODIR/${SAMPLE}_fc $OFILE1 $OFILE2
+	done
+done
+
+echo "${CG}${TITLE0} end${RC}"
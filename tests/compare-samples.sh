@@ -0,0 +1,32 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Comparing outputs of feature samples test"
+echo "${CG}${TITLE0} begin${RC}"
+
+for SAMPLE in div inline builtin args vector switch align; do
+	echo "Sample $SAMPLE..."
+	source ./compile-gcc.sh
+	source ./compile-fc.sh
+
+	IFILE1=$ODIR/${SAMPLE}_gcc
+	IFILE2=$ODIR/${SAMPLE}_fc
+	OFILE1=$TDIR/temp1
+	OFILE2=$TDIR/temp2
+
+	echo "Executing key sample..."
+	./$IFILE1 > $OFILE1
+	echo "Executing produced sample..."
+	./$IFILE2 > $OFILE2
+	echo "Calculating diff..."
+	if ! cmp $OFILE1 $OFILE2; then
+		echo "${CR}Files not matching${RC}"
+		exit 1
+	else
+		echo "...files match"
+	fi
+	echo "Clean up"
+	rm $IFILE1 $IFILE2 $OFILE1 $OFILE2
+done
+
+echo "${CG}${TITLE0} end${RC}"
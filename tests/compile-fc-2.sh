@@ -5,7 +5,7 @@ CCOUT=../cc0
 IFILE=$IDIR/sample
 OFILE=$ODIR/sample_fc
 echo "Compiling FemtoC with FemtoC..."
-cat $CCSRC.c | ../cc > $CCOUT.s
+cat $CCSRC.c | ../cc $FCFLAGS > $CCOUT.s
 if ! grep -q "no errors encountered" $CCOUT.s; then
 	echo "${CR}Compilation failed${RC}"
 	exit 1
@@ -21,7 +21,7 @@ if ! ld $CCOUT.o -o $CCOUT; then
 	exit 1
 fi
 echo "Compiling sample with stage 2 FemtoC..."
-cat $IFILE.c | $CCOUT > $OFILE.s
+cat $IFILE.c | $CCOUT $FCFLAGS > $OFILE.s
 if ! grep -q "no errors encountered" $OFILE.s; then
 	echo "${CR}Compilation failed${RC}"
 	exit 1
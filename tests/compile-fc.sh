@@ -1,9 +1,9 @@
 #!/bin/bash
 source ./common.sh
-IFILE=$IDIR/sample
-OFILE=$ODIR/sample_fc
+IFILE=$IDIR/${SAMPLE:-sample}
+OFILE=$ODIR/${SAMPLE:-sample}_fc
 echo "Compiling with FemtoC..."
-cat $IFILE.c | ../cc > $OFILE.s
+cat $IFILE.c | ../cc $FCFLAGS > $OFILE.s
 if ! grep -q "no errors encountered" $OFILE.s; then
 	echo "${CR}Compilation failed${RC}"
 	exit 1
@@ -1,9 +1,9 @@
 #!/bin/bash
 source ./common.sh
-IFILE=$IDIR/sample
-OFILE=$ODIR/sample_gcc
+IFILE=$IDIR/${SAMPLE:-sample}
+OFILE=$ODIR/${SAMPLE:-sample}_gcc
 echo "Building the key sample with GCC..."
-if ! gcc $IFILE.c -o $OFILE; then
+if ! gcc $GCCFLAGS $IFILE.c -o $OFILE; then
 	echo "${CR}Compilation failed${RC}"
 	exit 1
 fi
@@ -0,0 +1,65 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Profile round trip test"
+echo "${CG}${TITLE0} begin${RC}"
+
+# Builds a sample with FemtoC and given options, in the directory
+# the profile is written to and read from
+build() {
+	echo "Compiling with $1..."
+	(cd $TDIR && cat ../$IDIR/$SAMPLE.c | ../../cc $1 > $SAMPLE.s)
+	if ! grep -q "no errors encountered" $TDIR/$SAMPLE.s; then
+		echo "${CR}Compilation failed${RC}"
+		exit 1
+	fi
+	if ! as $TDIR/$SAMPLE.s -o $TDIR/$SAMPLE.o || ! ld $TDIR/$SAMPLE.o -o $2; then
+		echo "${CR}Assembly or linkage failed${RC}"
+		exit 1
+	fi
+	rm $TDIR/$SAMPLE.o
+}
+
+for SAMPLE in sample switch; do
+	echo "Sample $SAMPLE..."
+	source ./compile-gcc.sh
+	rm -f $TDIR/femtoc.prof
+
+	IFILE1=$ODIR/${SAMPLE}_gcc
+	IFILE2=$ODIR/${SAMPLE}_gen
+	IFILE3=$ODIR/${SAMPLE}_use
+	OFILE1=$TDIR/temp1
+	OFILE2=$TDIR/temp2
+	OFILE3=$TDIR/temp3
+
+	build "-O -fprofile-generate" $IFILE2
+	echo "Executing profiled sample..."
+	(cd $TDIR && ../$IFILE2 > ../$OFILE2)
+	if [ ! -s $TDIR/femtoc.prof ]; then
+		echo "${CR}No profile written${RC}"
+		exit 1
+	fi
+
+	build "-O -fprofile-use" $IFILE3
+	# Code the run never reached is moved out of the way
+	if grep -q "No profile" $TDIR/$SAMPLE.s \
+			|| ! grep -q "text.unlikely" $TDIR/$SAMPLE.s; then
+		echo "${CR}Profile not read back${RC}"
+		exit 1
+	fi
+	echo "Executing sample built with the profile..."
+	./$IFILE3 > $OFILE3
+	./$IFILE1 > $OFILE1
+	echo "Calculating diff..."
+	if ! cmp $OFILE1 $OFILE2 || ! cmp $OFILE1 $OFILE3; then
+		echo "${CR}Files not matching${RC}"
+		exit 1
+	else
+		echo "...files match"
+	fi
+	echo "Clean up"
+	rm $IFILE1 $IFILE2 $IFILE3 $OFILE1 $OFILE2 $OFILE3
+	rm $TDIR/$SAMPLE.s $TDIR/femtoc.prof
+done
+
+echo "${CG}${TITLE0} end${RC}"
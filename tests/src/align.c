@@ -0,0 +1,96 @@
+/* Globals in .data and .bss, and the alignment they get by default
+ * or ask for with an attribute */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+int seven = 7;
+int zero = 0;
+char flag __attribute__((aligned(16))) = 102;
+char byte0 = 0;
+int counter __attribute__((aligned(64))) = 0;
+char line[80] __attribute__((aligned(128)));
+char small[10];
+int few[4];
+int big[100];
+
+int main() {
+	int i = 0;
+	int s = 0;
+	printf ("%i %i %i%c", seven, zero, flag, 10);
+	printf ("%i %i%c", byte0, counter, 10);
+	while (i < 100) {
+		s = s + *((int*) big + i);
+		*((int*) big + i) = i;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 80) {
+		s = s + *((char*) line + i);
+		*((char*) line + i) = (char) i % 26 + 'a';
+		i = i + 1;
+	}
+	*((char*) line + 79) = (char) 0;
+	printf ("%i %i %s%c", s, *((int*) big + 99), (char*) line + 70, 10);
+	counter = counter + seven;
+	zero = counter * 2;
+	*((int*) few + 3) = zero;
+	*((char*) small + 9) = flag;
+	printf ("%i %i %i %c%c", counter, zero, *((int*) few + 3), *((char*) small + 9), 10);
+	return 0;
+}
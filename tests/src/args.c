@@ -0,0 +1,114 @@
+/* Functions taking more arguments than -abi=sysv passes in registers */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+int seven(int a, int b, int c, int d, int e, int f, int g) {
+	return ((((((a * 2) + b) * 2) + c) * 2) + ((d + e) + (f * g)));
+}
+
+int nine(int a, int b, int c, int d, int e, int f, int g, int h, int i) {
+	return (((a + b) + (c * d)) + (e - f)) + ((g * 100) + ((h * 10) + i));
+}
+
+char *pick(char *a, char *b, char *c, char *d, char *e, char *f, char *g, int n) {
+	if (n == 6) {
+		return g;
+	}
+	return a;
+}
+
+int down(int n, int a, int b, int c, int d, int e, int f, int g) {
+	if (n == 0) {
+		return g;
+	}
+	return down (n - 1, a, b, c, d, e, f, g + (n * a)) + 1;
+}
+
+/* The loop takes registers the callee saves, above the arguments */
+int looped(int a, int b, int c, int d, int e, int f, int g, int h) {
+	int i = 0;
+	int s = 0;
+	while (i < b) {
+		s = s + ((a * c) + (d * e));
+		i = i + 1;
+	}
+	return ((g * 10) + h) + (s * 100);
+}
+
+/* Calls itself in tail position, a jump with -O */
+int again(int n, int a, int b, int c, int d, int e, int f, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return again (n - 1, a, b, c, d, e, f + 1, (acc + f) + a);
+}
+
+int main() {
+	int i = 0;
+	int s = 0;
+	while (i < 5) {
+		s = seven (i, 1, 2, 3, 4, 5, i + 6);
+		printf ("%i %i %i%c", s, nine (1, 2, 3, 4, 5, 6, i, 8, 9), down (i, 3, 0, 0, 0, 0, 0, 7), 10);
+		i = i + 1;
+	}
+	s = seven (seven (1, 1, 1, 1, 1, 1, 1), 2, 3, 4, 5, nine (9, 8, 7, 6, 5, 4, 3, 2, 1), 7);
+	printf ("%i %i%c", looped (1, 2, 3, 4, 5, 6, 7, 8), again (8, 1, 0, 0, 0, 0, 5, 0), 10);
+	printf ("%i %s%c", s, pick ("a", "b", "c", "d", "e", "f", "g", 6), 10);
+	return 0;
+}
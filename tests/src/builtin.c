@@ -0,0 +1,120 @@
+/* Constant-size __builtin_memcpy and __builtin_memset, done with
+ * moves up to MEM_UNROLL bytes and with rep past it */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+char src[128];
+char dst[128];
+
+int sum(char *p, int n) {
+	int s = 0;
+	int i = 0;
+	while (i < n) {
+		s = (s * 31) + (*(p + i) + i);
+		s = s % 1000003;
+		i = i + 1;
+	}
+	return s;
+}
+
+int reset() {
+	int i = 0;
+	while (i < 128) {
+		*((char*) src + i) = (char) i % 50 + 1;
+		*((char*) dst + i) = (char) 0;
+		i = i + 1;
+	}
+	return 0;
+}
+
+int main() {
+	char *d = dst;
+	reset ();
+	__builtin_memcpy (dst, src, 1);
+	__builtin_memcpy (dst + 2, src + 5, 3);
+	__builtin_memcpy (dst + 8, src, 8);
+	__builtin_memcpy (dst + 17, src + 3, 13);
+	printf ("copy small %i %i%c", sum (dst, 40), *((char*) dst + 19), 10);
+	reset ();
+	__builtin_memcpy (dst, src, 16);
+	__builtin_memcpy (dst + 20, src + 1, 24);
+	__builtin_memcpy (dst + 50, src + 7, 33);
+	printf ("copy wide %i %i%c", sum (dst, 90), *((char*) dst + 60), 10);
+	reset ();
+	d = __builtin_memcpy (dst + 1, src, 64);
+	printf ("copy max %i %i%c", sum (dst, 70), d - dst, 10);
+	reset ();
+	__builtin_memcpy (dst, src, 100);
+	printf ("copy rep %i%c", sum (dst, 110), 10);
+	reset ();
+	__builtin_memset (dst, 9, 1);
+	__builtin_memset (dst + 3, 'a', 5);
+	__builtin_memset (dst + 10, 'b', 8);
+	printf ("fill small %i %i%c", sum (dst, 20), *((char*) dst + 12), 10);
+	reset ();
+	__builtin_memset (dst + 1, 'c', 12);
+	__builtin_memset (dst + 20, 'd', 32);
+	__builtin_memset (dst + 55, 'e', 40);
+	printf ("fill wide %i %i%c", sum (dst, 100), *((char*) dst + 70), 10);
+	reset ();
+	d = __builtin_memset (dst + 2, 0, 64);
+	__builtin_memset (dst + 70, 'f', 100 - 50);
+	printf ("fill max %i %i%c", sum (dst, 128), d - dst, 10);
+	return 0;
+}
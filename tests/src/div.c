@@ -0,0 +1,93 @@
+/* Divisions and remainders feeding each other */
+
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+int garr[64];
+
+int mix(int acc, int l0, int a0, int a2) {
+	return (acc + ((l0 % ((*((int*) garr + 5) && 4) | 1)) * *((int*) garr + ((a0 < a2) % 641))));
+}
+
+int chain(int a, int b, int c) {
+	return ((a % b) / ((c % 7) + 1)) + ((a / ((b % c) + 1)) % 3);
+}
+
+/* Constant divisors multiply by a magic number in rdx:rax */
+int magic(int a, int b, int c, int d) {
+	return (a % b) + (c + (d / 7));
+}
+
+int magic_rem(int a, int b, int c, int d) {
+	return (a % b) + (c + (d % 10));
+}
+
+int main() {
+	int i = 0;
+	*((int*) garr + 5) = 9;
+	*((int*) garr + 1) = 4;
+	printf ("%i%c", mix (100, 0, 5, 8), 10);
+	printf ("%i%c", mix (100, 7, 5, 8), 10);
+	printf ("%i %i%c", magic (100, 7, 50, 1000), magic_rem (99, 8, 77, 1234), 10);
+	while (i < 20) {
+		printf ("%i %i%c", chain (1000 + i, 17 + i, 5 + i), ((i * 37) % (i + 3)) % 5, 10);
+		i = i + 1;
+	}
+	return 0;
+}
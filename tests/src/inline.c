@@ -0,0 +1,104 @@
+/* Functions marked inline, and small ones inlined without it */
+
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+/* A prototype without inline makes gcc emit the functions as well */
+int sq(int x);
+int lerp(int a, int b, int t);
+int clamp(int v, int lo, int hi);
+
+inline int sq(int x) {
+	return x * x;
+}
+
+/* Too large to be inlined without the keyword */
+inline int lerp(int a, int b, int t) {
+	return (((a * (100 - t)) + (b * t)) + ((a + b) % 3)) / 100;
+}
+
+inline int clamp(int v, int lo, int hi) {
+	return (((v < lo) * lo) + (((v >= lo) * (v > hi)) * hi)) + (((v >= lo) * (v <= hi)) * v);
+}
+
+int small(int x) {
+	return x + 1;
+}
+
+int add3(int a, int b, int c) {
+	return ((a * 100) + (b * 10)) + c;
+}
+
+/* Its body calls another function, so it is not inlined itself */
+int wrap(int x, int y) {
+	return add3 (y, x, 5);
+}
+
+int main() {
+	int i = 0;
+	int s = 0;
+	while (i < 10) {
+		s = s + sq (i) + small (i);
+		printf ("%i %i%c", lerp (i, 100 + i, i * 10), clamp (sq (i) - 20, 0, 40), 10);
+		i = i + 1;
+	}
+	printf ("%i %i%c", s, sq (sq (3)), 10);
+	printf ("%i %i%c", wrap (1, 2), add3 (wrap (3, 4), 7, sq (2)), 10);
+	return 0;
+}
@@ -0,0 +1,93 @@
+/* Order arguments are evaluated in, which optimizations keep: last to
+ * first by default, first to last with -abi=sysv. Inlined calls too. */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+int seen = 0;
+
+/* Records that an argument was evaluated */
+int id(int v) {
+	seen = ((seen * 10) + v) % 1000000007;
+	return v;
+}
+
+int sum4(int a, int b, int c, int d) {
+	return ((a + b) + c) + d;
+}
+
+int pick(int a, int b) {
+	return a;
+}
+
+int both(int a, int b, int c, int d, int e, int f, int g) {
+	return (((a + b) + (c + d)) + ((e + f) + g)) * 2;
+}
+
+int main() {
+	int a0 = 2;
+	int s = sum4 (id (1), 2, 3, id (4) * a0);
+	printf ("%i %i%c", s, seen, 10);
+	seen = 0;
+	s = pick (id (5), id (6)) + sum4 (id (1), id (2), id (3), pick (id (7), 8));
+	printf ("%i %i%c", s, seen, 10);
+	seen = 0;
+	s = both (id (1), id (2), id (3), id (4), id (5), id (6), id (7));
+	printf ("%i %i%c", s, seen, 10);
+	return 0;
+}
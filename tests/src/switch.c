@@ -0,0 +1,174 @@
+/* Switch statements: dense cases go through a jump table, sparse ones
+ * through a search, long literals are compared one by one */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+/* Dense, with a gap and the default in the middle */
+int dense(int x) {
+	int r = 0;
+	switch (x) {
+	case 0: r = 10; break;
+	case 1: r = 11; break;
+	case 2: r = 12; break;
+	default: r = 99; break;
+	case 4: r = 14; break;
+	case 5: r = 15; break;
+	case 6: r = 16; break;
+	}
+	return r;
+}
+
+/* Sparse, up to literals of ten digits */
+int sparse(int x) {
+	switch (x) {
+	case 0 - 7: return 1;
+	case 3: return 2;
+	case 100: return 3;
+	case 1000: return 4;
+	case 65536: return 5;
+	case 536870911: return 6;
+	case 536870912: return 7;
+	case 1073741824: return 8;
+	case 1610612736: return 9;
+	case 2000000000: return 10;
+	}
+	return 0;
+}
+
+/* Falls through, with no default */
+int through(int x) {
+	int r = 0;
+	switch (x) {
+	case 1: r = r + 1;
+	case 2: r = r + 10;
+	case 3: r = r + 100; break;
+	case 4:
+	case 5: r = r + 1000;
+	}
+	return r;
+}
+
+/* Nested, the inner break leaves the inner switch only */
+int nested(int x, int y) {
+	int r = 0;
+	switch (x) {
+	case 1:
+		switch (y) {
+		case 1: r = 11; break;
+		case 2: r = 12; break;
+		case 1073741824: r = 13; break;
+		default: r = 19;
+		}
+		r = r + 100;
+		break;
+	case 2:
+		switch (y) {
+		case 0: case 1: case 2: case 3: r = 20 + y; break;
+		}
+		break;
+	default:
+		r = 77;
+	}
+	return r;
+}
+
+/* Inside a loop, continue goes on with the loop */
+int loop(int n) {
+	int i = 0;
+	int r = 0;
+	while (i < n) {
+		i = i + 1;
+		switch (i % 4) {
+		case 0: continue;
+		case 1: r = r + i; break;
+		default: r = r + 1;
+		}
+		r = r * 2;
+	}
+	return r;
+}
+
+int main() {
+	int i = 0;
+	int big[6];
+	*((int*) big + 0) = 536870911;
+	*((int*) big + 1) = 536870912;
+	*((int*) big + 2) = 1073741824;
+	*((int*) big + 3) = 1073741825;
+	*((int*) big + 4) = 1610612736;
+	*((int*) big + 5) = 2000000000;
+	while (i < 8) {
+		printf ("%i: %i %i %i%c", i, dense (i), sparse (i), through (i), 10);
+		i = i + 1;
+	}
+	printf ("%i %i%c", dense (0 - 1), through (0 - 1), 10);
+	printf ("%i %i %i %i%c", sparse (0 - 7), sparse (100), sparse (1000), sparse (65536), 10);
+	i = 0;
+	while (i < 6) {
+		printf ("big %i %i%c", sparse (*((int*) big + i)), nested (1, *((int*) big + i)), 10);
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 5) {
+		printf ("nested %i %i %i%c", nested (1, i), nested (2, i), nested (3, i), 10);
+		i = i + 1;
+	}
+	printf ("loop %i %i%c", loop (5), loop (11), 10);
+	return 0;
+}
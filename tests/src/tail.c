@@ -0,0 +1,98 @@
+/* Tail calls deep enough to overflow the stack unless they are turned
+ * into jumps, which -O does */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+int count(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return count (n - 1, (acc + n) % 1000003);
+}
+
+/* More arguments than -abi=sysv passes in registers */
+int walk(int n, int a, int b, int c, int d, int e, int f, int acc) {
+	if (n == 0) {
+		return (acc * 10) + f;
+	}
+	return walk (n - 1, b, c, d, e, f, a, (acc + (a * f)) % 1000003);
+}
+
+int odd(int n, int acc);
+
+int even(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return odd (n - 1, acc + 2);
+}
+
+int odd(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return even (n - 1, acc + 1);
+}
+
+int main() {
+	printf ("%i%c", count (10000000, 0), 10);
+	printf ("%i%c", walk (10000000, 1, 2, 3, 4, 5, 6, 0), 10);
+	printf ("%i %i%c", even (10000000, 0), odd (10000001, 0), 10);
+	return 0;
+}
@@ -0,0 +1,209 @@
+/* Fill and copy loops the vector pass rewrites with -O, run over
+ * lengths around the vector width and over overlapping buffers */
+#include <stdio.h>
+
+#if 0
+int putc(char c) {
+	asm {
+	movq $1, %rax        # syscall = write
+	movq $1, %rdi        # file = stdout
+	leaq 8(%rbp), %rsi   # buffer = &c
+	movq $1, %rdx        # count = 1
+	syscall
+	}
+}
+
+int putn(int n) {
+	char buf[10];
+	char *ptr=buf;
+	if (n == 0) {
+		putc ('0');
+		return 0;
+	}
+	while (n > 0) {
+		*ptr = (char) n % 10 + '0';
+		ptr = ptr + 1;
+		n = n / 10;
+	}
+	while (ptr != buf) {
+		ptr = ptr - 1;
+		putc (*ptr);
+	}
+}
+
+int puts(char *s) {
+	while (*s) {
+		putc (*s);
+		s = s + 1;
+	}
+}
+
+int printf(char *fmt) {
+	int *arg = (int*) &fmt + 1;
+	while (*fmt) {
+		if (*fmt == '%') {
+			fmt = fmt + 1;
+			if (*fmt == 'c') {
+				putc (*arg);
+			} else if (*fmt == 's') {
+				puts (*arg);
+			} else if (*fmt == 'i') {
+				putn (*arg);
+			}
+			arg = arg + 1;
+		} else {
+			putc (*fmt);
+		}
+		fmt = fmt + 1;
+	}
+}
+#endif
+
+char buf[400];
+int ibuf[120];
+
+int fill_up(char *p, int n, int c) {
+	int i = 0;
+	while (i < n) {
+		*(p + i) = (char) c;
+		i = i + 1;
+	}
+	return 0;
+}
+
+int fill_count(char *p, int n, int c) {
+	while (n > 0) {
+		*p = (char) c;
+		p = p + 1;
+		n = n - 1;
+	}
+	return 0;
+}
+
+int copy_up(char *d, char *s, int n) {
+	int i = 0;
+	while (i < n) {
+		*(d + i) = *(s + i);
+		i = i + 1;
+	}
+	return 0;
+}
+
+int copy_ptr(char *d, char *s, int n) {
+	char *e = s + n;
+	while (s != e) {
+		*d = *s;
+		d = d + 1;
+		s = s + 1;
+	}
+	return 0;
+}
+
+int fill_int(int *d, int n, int v) {
+	int i = 0;
+	while (i < n) {
+		*(d + i) = v;
+		i = i + 1;
+	}
+	return 0;
+}
+
+int copy_int(int *d, int *s, int n) {
+	while (n != 0) {
+		*d = *s;
+		d = d + 1;
+		s = s + 1;
+		n = n - 1;
+	}
+	return 0;
+}
+
+int reset() {
+	int i = 0;
+	int c = 0;
+	while (i < 400) {
+		c = i % 90;
+		*((char*) buf + i) = (char) c + 1;
+		i = i + 1;
+	}
+	i = 0;
+	while (i < 120) {
+		*((int*) ibuf + i) = i + 1;
+		i = i + 1;
+	}
+	return 0;
+}
+
+int sum(char *p, int n) {
+	int s = 0;
+	int i = 0;
+	while (i < n) {
+		s = (s * 31) + (*(p + i) + i);
+		s = s % 1000003;
+		i = i + 1;
+	}
+	return s;
+}
+
+int isum(int *p, int n) {
+	int s = 0;
+	int i = 0;
+	while (i < n) {
+		s = (s * 31) + (*(p + i) + i);
+		s = s % 1000003;
+		i = i + 1;
+	}
+	return s;
+}
+
+int main() {
+	char *b = buf;
+	int *q = ibuf;
+	int n = 0;
+	int len[9];
+	*((int*) len + 0) = 0;
+	*((int*) len + 1) = 1;
+	*((int*) len + 2) = 15;
+	*((int*) len + 3) = 16;
+	*((int*) len + 4) = 17;
+	*((int*) len + 5) = 31;
+	*((int*) len + 6) = 33;
+	*((int*) len + 7) = 64;
+	*((int*) len + 8) = 100;
+	while (n < 9) {
+		reset ();
+		fill_up (b + 3, *((int*) len + n), 'a');
+		fill_count (b + 150, *((int*) len + n), 'b');
+		printf ("fill %i %i %i%c", *((int*) len + n), sum (b, 260), 0, 10);
+		reset ();
+		copy_up (b + 200, b + 1, *((int*) len + n));
+		copy_ptr (b + 2, b + 300, *((int*) len + n));
+		printf ("copy %i %i%c", *((int*) len + n), sum (b, 400), 10);
+		reset ();
+		fill_int (q + 1, *((int*) len + n), 7);
+		printf ("fill int %i %i%c", *((int*) len + n), isum (q, 120), 10);
+		reset ();
+		copy_int (q + 10, q + 60, *((int*) len + n) / 2);
+		printf ("copy int %i %i%c", *((int*) len + n), isum (q, 120), 10);
+		n = n + 1;
+	}
+
+	/* The destination right after the source repeats its start,
+	 * a vector or more after it the copy moves ahead as usual */
+	n = 1;
+	while (n < 24) {
+		reset ();
+		copy_up (b + 10 + n, b + 10, 100);
+		copy_ptr (b + 200, b + 200 + n, 100);
+		printf ("overlap %i %i%c", n, sum (b, 400), 10);
+		reset ();
+		copy_int (q + n, q, 60);
+		copy_int (q + 70, q + 70 + (n % 5), 40);
+		printf ("overlap int %i %i%c", n, isum (q, 120), 10);
+		n = n + 1;
+	}
+	reset ();
+	copy_up (b, b, 50);
+	printf ("same %i%c", sum (b, 100), 10);
+	return 0;
+}
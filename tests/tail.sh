@@ -0,0 +1,38 @@
+#!/bin/bash
+source ./common.sh
+
+TITLE0="Deep tail calls test"
+echo "${CG}${TITLE0} begin${RC}"
+
+# Without the calls turned into jumps the stack overflows,
+# gcc only does that when optimizing as well
+SAMPLE=tail
+GCCFLAGS=-O2
+source ./compile-gcc.sh
+
+for FCFLAGS in "-O" "-O -abi=sysv"; do
+	echo "Options $FCFLAGS..."
+	source ./compile-fc.sh
+
+	IFILE1=$ODIR/${SAMPLE}_gcc
+	IFILE2=$ODIR/${SAMPLE}_fc
+	OFILE1=$TDIR/temp1
+	OFILE2=$TDIR/temp2
+
+	echo "Executing key sample..."
+	./$IFILE1 > $OFILE1
+	echo "Executing produced sample..."
+	./$IFILE2 > $OFILE2
+	echo "Calculating diff..."
+	if ! cmp $OFILE1 $OFILE2; then
+		echo "${CR}Files not matching${RC}"
+		exit 1
+	else
+		echo "...files match"
+	fi
+	rm $IFILE2 $OFILE1 $OFILE2
+done
+echo "Clean up"
+rm $ODIR/${SAMPLE}_gcc
+
+echo "${CG}${TITLE0} end${RC}"